@@ -0,0 +1,100 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_CONFIG_H_
+#define FREERTOS_CONFIG_H_
+
+/**
+ * FreeRTOS configuration for the host benchmarks, which run on the GCC/POSIX port.
+ *
+ * Each FreeRTOS task is backed by a pthread, so absolute numbers are not representative of
+ * a target processor. The relative cost of the wrappers vs. the raw kernel calls is what
+ * we are interested in.
+ */
+
+#define configUSE_PREEMPTION 1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION 0
+#define configUSE_IDLE_HOOK 0
+#define configUSE_TICK_HOOK 0
+#define configTICK_RATE_HZ 1000
+#define configMAX_PRIORITIES 32
+#define configMINIMAL_STACK_SIZE ((unsigned short)4096)
+#define configMAX_TASK_NAME_LEN 16
+#define configUSE_16_BIT_TICKS 0
+#define configIDLE_SHOULD_YIELD 1
+#define configUSE_TASK_NOTIFICATIONS 1
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES 6
+#define configUSE_MUTEXES 1
+#define configUSE_RECURSIVE_MUTEXES 1
+#define configUSE_COUNTING_SEMAPHORES 1
+#define configQUEUE_REGISTRY_SIZE 0
+#define configUSE_QUEUE_SETS 0
+#define configUSE_TIME_SLICING 1
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 2
+#define configSTACK_DEPTH_TYPE uint32_t
+
+#define configSUPPORT_STATIC_ALLOCATION 1
+#define configSUPPORT_DYNAMIC_ALLOCATION 1
+#define configTOTAL_HEAP_SIZE ((size_t)(256 * 1024))
+#define configAPPLICATION_ALLOCATED_HEAP 0
+
+#define configCHECK_FOR_STACK_OVERFLOW 0
+#define configUSE_MALLOC_FAILED_HOOK 0
+#define configUSE_DAEMON_TASK_STARTUP_HOOK 0
+#define configGENERATE_RUN_TIME_STATS 0
+#define configUSE_TRACE_FACILITY 0
+#define configUSE_STATS_FORMATTING_FUNCTIONS 0
+#define configUSE_CO_ROUTINES 0
+
+// EventFlag::setFromISR() defers the bit update to the timer task
+#define configUSE_TIMERS 1
+#define configTIMER_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define configTIMER_QUEUE_LENGTH 16
+#define configTIMER_TASK_STACK_DEPTH configMINIMAL_STACK_SIZE
+
+#define INCLUDE_vTaskPrioritySet 1
+#define INCLUDE_uxTaskPriorityGet 1
+#define INCLUDE_vTaskDelete 1
+#define INCLUDE_vTaskSuspend 1
+#define INCLUDE_vTaskDelayUntil 1
+#define INCLUDE_vTaskDelay 1
+#define INCLUDE_xTaskGetSchedulerState 1
+#define INCLUDE_xTaskGetCurrentTaskHandle 1
+#define INCLUDE_eTaskGetState 1
+#define INCLUDE_xTaskGetIdleTaskHandle 0
+#define INCLUDE_xTaskAbortDelay 0
+#define INCLUDE_xTaskGetHandle 0
+#define INCLUDE_xTaskResumeFromISR 1
+#define INCLUDE_xTimerPendFunctionCall 1
+
+#define configASSERT(x)                                     \
+	if((x) == 0)                                            \
+	{                                                       \
+		vAssertCalled(__FILE__, __LINE__);                  \
+	}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void vAssertCalled(const char* file, unsigned long line);
+#ifdef __cplusplus
+}
+
+/// Task priority mapping used by os::freertos::Thread
+enum freertos_port_priorities
+{
+	panic = 31,
+	interrupt = 31,
+	realtime = 30,
+	veryHigh = 25,
+	high = 20,
+	aboveNormal = 15,
+	normal = 10,
+	belowNormal = 5,
+	low = 3,
+	lowest = 1,
+	idle = 0
+};
+#endif
+
+#endif // FREERTOS_CONFIG_H_
@@ -0,0 +1,132 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef BENCHMARK_HARNESS_HPP_
+#define BENCHMARK_HARNESS_HPP_
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+namespace benchmark
+{
+#ifndef BENCHMARK_SAMPLE_COUNT
+#define BENCHMARK_SAMPLE_COUNT 2000
+#endif
+
+#ifndef BENCHMARK_WARMUP_COUNT
+#define BENCHMARK_WARMUP_COUNT 100
+#endif
+
+static inline constexpr size_t MAX_SAMPLES = BENCHMARK_SAMPLE_COUNT;
+static inline constexpr size_t WARMUP_SAMPLES = BENCHMARK_WARMUP_COUNT;
+
+using clock = std::chrono::steady_clock;
+
+/** Collects latency samples for a single operation and reports their distribution.
+ *
+ * Samples are stored in nanoseconds. The distribution is reported as min/median/p90/p99/max,
+ * since the tail matters as much as the average for a real-time system.
+ */
+class LatencyRecorder
+{
+  public:
+	void clear() noexcept
+	{
+		count_ = 0;
+	}
+
+	void record(clock::duration d) noexcept
+	{
+		if(count_ < MAX_SAMPLES)
+		{
+			samples_[count_++] = static_cast<uint32_t>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+		}
+	}
+
+	void report(const char* name) noexcept
+	{
+		if(count_ == 0)
+		{
+			printf("%-48s %8s\n", name, "no samples");
+			return;
+		}
+
+		std::sort(samples_.begin(), samples_.begin() + count_);
+
+		printf("%-48s %8zu %8u %8u %8u %8u %8u\n", name, count_, samples_[0], percentile(50),
+			   percentile(90), percentile(99), samples_[count_ - 1]);
+	}
+
+	static void print_header() noexcept
+	{
+		printf("%-48s %8s %8s %8s %8s %8s %8s\n", "operation (ns)", "samples", "min", "p50",
+			   "p90", "p99", "max");
+	}
+
+  private:
+	uint32_t percentile(size_t p) const noexcept
+	{
+		return samples_[((count_ - 1) * p) / 100];
+	}
+
+  private:
+	std::array<uint32_t, MAX_SAMPLES> samples_{};
+	size_t count_ = 0;
+};
+
+/** Time an operation repeatedly and report the latency distribution.
+ *
+ * @param name The name printed in the report.
+ * @param op The operation under test. It is called WARMUP_SAMPLES times before
+ *	measurement begins.
+ * @param samples The number of timed calls to make.
+ */
+template<typename TOp>
+void measure(const char* name, TOp&& op, size_t samples = MAX_SAMPLES) noexcept
+{
+	static LatencyRecorder recorder;
+	recorder.clear();
+
+	for(size_t i = 0; i < WARMUP_SAMPLES; i++)
+	{
+		op();
+	}
+
+	for(size_t i = 0; i < samples; i++)
+	{
+		auto start = clock::now();
+		op();
+		recorder.record(clock::now() - start);
+	}
+
+	recorder.report(name);
+}
+
+/** Time an operation that needs untimed setup or teardown around each sample.
+ *
+ * @param name The name printed in the report.
+ * @param op The operation under test. It receives a LatencyRecorder and is responsible for
+ *	calling record() with the interval it wants to measure.
+ * @param samples The number of times to invoke op.
+ */
+template<typename TOp>
+void measure_manual(const char* name, TOp&& op, size_t samples = MAX_SAMPLES) noexcept
+{
+	static LatencyRecorder recorder;
+	recorder.clear();
+
+	for(size_t i = 0; i < samples; i++)
+	{
+		op(recorder);
+	}
+
+	recorder.report(name);
+}
+
+} // namespace benchmark
+
+#endif // BENCHMARK_HARNESS_HPP_
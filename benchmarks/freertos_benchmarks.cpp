@@ -0,0 +1,717 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#include "benchmark_harness.hpp"
+#include <FreeRTOS.h>
+#include <cstdio>
+#include <cstdlib>
+#include <event_groups.h>
+#include <os.hpp>
+#include <queue.h>
+#include <semphr.h>
+#include <task.h>
+
+/**
+ * Latency benchmarks for the FreeRTOS interface wrappers.
+ *
+ * Each wrapper operation is paired with the equivalent raw FreeRTOS call, so the report shows
+ * the cost of the wrapper and virtual dispatch layers on top of the kernel.
+ */
+
+using namespace benchmark;
+
+#pragma mark - Definitions -
+
+namespace
+{
+constexpr size_t BENCHMARK_STACK_SIZE = 16 * 1024;
+constexpr size_t THREAD_SAMPLE_COUNT = 200;
+constexpr UBaseType_t BENCHMARK_PRIORITY = freertos_port_priorities::high;
+
+void idle_thread(void* arg) noexcept
+{
+	(void)arg;
+
+	while(1)
+	{
+		vTaskDelay(portMAX_DELAY);
+	}
+}
+
+/// Let the idle task reclaim the memory of deleted tasks.
+void reclaim_deleted_tasks() noexcept
+{
+	vTaskDelay(1);
+}
+
+} // namespace
+
+#pragma mark - Mutex -
+
+namespace
+{
+struct ContendedLock
+{
+	embvm::VirtualMutex* mutex;
+	clock::time_point released{};
+	volatile bool held = false;
+	volatile bool done = false;
+};
+
+void mutex_contender(void* arg) noexcept
+{
+	auto c = reinterpret_cast<ContendedLock*>(arg);
+
+	while(!c->done)
+	{
+		c->mutex->lock();
+		c->held = true;
+		vTaskDelay(1);
+		c->held = false;
+		c->released = clock::now();
+		c->mutex->unlock();
+		taskYIELD();
+	}
+
+	idle_thread(nullptr);
+}
+
+/// Measure the time from a lower priority owner releasing the mutex until the blocked
+/// benchmark task owns it.
+void measure_contended(const char* name, embvm::VirtualMutex* mutex) noexcept
+{
+	ContendedLock c{mutex};
+	TaskHandle_t contender;
+
+	xTaskCreate(mutex_contender, "contender", BENCHMARK_STACK_SIZE / sizeof(StackType_t), &c,
+				BENCHMARK_PRIORITY - 1, &contender);
+
+	measure_manual(
+		name,
+		[&](LatencyRecorder& r) {
+			while(!c.held)
+			{
+				vTaskDelay(1);
+			}
+
+			mutex->lock();
+			r.record(clock::now() - c.released);
+			mutex->unlock();
+		},
+		THREAD_SAMPLE_COUNT);
+
+	c.done = true;
+	vTaskDelay(2);
+	vTaskDelete(contender);
+	reclaim_deleted_tasks();
+}
+} // namespace
+
+static void benchmark_contended_mutex() noexcept
+{
+	auto mutex = os::Factory::createMutex();
+	measure_contended("VirtualMutex unlock->lock handoff", mutex);
+	os::Factory::destroy(mutex);
+
+	auto fast = os::freertos::freertosOSFactory_impl::createFastMutex_impl();
+	measure_contended("FastMutex unlock->lock handoff", fast);
+	os::freertos::freertosOSFactory_impl::destroy_impl(fast);
+}
+
+static void benchmark_mutex() noexcept
+{
+	auto raw = xSemaphoreCreateMutex();
+	measure("raw xSemaphoreTake/Give (mutex)", [&] {
+		xSemaphoreTake(raw, portMAX_DELAY);
+		xSemaphoreGive(raw);
+	});
+	vSemaphoreDelete(raw);
+
+	auto raw_recursive = xSemaphoreCreateRecursiveMutex();
+	measure("raw xSemaphoreTake/GiveRecursive", [&] {
+		xSemaphoreTakeRecursive(raw_recursive, portMAX_DELAY);
+		xSemaphoreGiveRecursive(raw_recursive);
+	});
+	vSemaphoreDelete(raw_recursive);
+
+	os::freertos::Mutex direct;
+	measure("Mutex::lock/unlock", [&] {
+		direct.lock();
+		direct.unlock();
+	});
+
+	os::freertos::StaticMutex<> static_mutex;
+	measure("StaticMutex::lock/unlock", [&] {
+		static_mutex.lock();
+		static_mutex.unlock();
+	});
+
+	os::freertos::FastMutex fast_mutex;
+	measure("FastMutex::lock/unlock", [&] {
+		fast_mutex.lock();
+		fast_mutex.unlock();
+	});
+
+	embvm::VirtualMutex* virt = os::Factory::createMutex();
+	measure("VirtualMutex::lock/unlock", [&] {
+		virt->lock();
+		virt->unlock();
+	});
+	os::Factory::destroy(virt);
+
+	embvm::VirtualMutex* recursive = os::Factory::createMutex(embvm::mutex::type::recursive);
+	measure("VirtualMutex::lock/unlock (recursive)", [&] {
+		recursive->lock();
+		recursive->unlock();
+	});
+	os::Factory::destroy(recursive);
+
+	embvm::VirtualMutex* virt_fast = os::freertos::freertosOSFactory_impl::createFastMutex_impl();
+	measure("VirtualMutex::lock/unlock (FastMutex)", [&] {
+		virt_fast->lock();
+		virt_fast->unlock();
+	});
+	os::freertos::freertosOSFactory_impl::destroy_impl(
+		static_cast<os::freertos::FastMutex*>(virt_fast));
+
+	benchmark_contended_mutex();
+}
+
+#pragma mark - Semaphore -
+
+static void benchmark_semaphore() noexcept
+{
+	auto raw = xSemaphoreCreateCounting(1, 1);
+	measure("raw xSemaphoreGive/Take (counting)", [&] {
+		xSemaphoreTake(raw, portMAX_DELAY);
+		xSemaphoreGive(raw);
+	});
+	vSemaphoreDelete(raw);
+
+	os::freertos::StaticSemaphore static_semaphore(embvm::semaphore::mode::counting, 1, 1);
+	measure("StaticSemaphore::take/give", [&] {
+		static_semaphore.take();
+		static_semaphore.give();
+	});
+
+	embvm::VirtualSemaphore* virt = os::Factory::createSemaphore(
+		embvm::semaphore::mode::counting, 1, 1);
+	measure("VirtualSemaphore::take/give", [&] {
+		virt->take();
+		virt->give();
+	});
+	os::Factory::destroy(virt);
+}
+
+#pragma mark - Event Flag -
+
+static void benchmark_event_flag() noexcept
+{
+	constexpr EventBits_t bit = 0x1;
+
+	auto raw = xEventGroupCreate();
+	measure("raw xEventGroupSetBits/WaitBits", [&] {
+		xEventGroupSetBits(raw, bit);
+		xEventGroupWaitBits(raw, bit, pdTRUE, pdFALSE, portMAX_DELAY);
+	});
+	vEventGroupDelete(raw);
+
+	os::freertos::StaticEventFlag static_flag;
+	measure("StaticEventFlag::set/get", [&] {
+		static_flag.set(bit);
+		static_flag.get(bit);
+	});
+
+	embvm::VirtualEventFlag* virt = os::Factory::createEventFlag();
+	measure("VirtualEventFlag::set/get", [&] {
+		virt->set(bit);
+		virt->get(bit);
+	});
+	os::Factory::destroy(virt);
+}
+
+#pragma mark - Message Queue -
+
+namespace
+{
+constexpr size_t FRAME_SIZE = 512;
+
+struct Frame
+{
+	uint8_t data[FRAME_SIZE];
+};
+} // namespace
+
+/// Compare copying a sensor-frame-sized message through the queue with passing a block pointer.
+static void benchmark_large_messages() noexcept
+{
+	constexpr size_t queue_length = 4;
+
+	auto copy_queue = os::Factory::createMessageQueue<Frame>(queue_length);
+	Frame frame{};
+	measure("MessageQueue<512 B> push/pop (copy)", [&] {
+		frame.data[0]++;
+		copy_queue->push(frame);
+		auto received = copy_queue->pop();
+		frame.data[1] = received->data[0];
+	});
+	delete copy_queue;
+
+	static os::freertos::ZeroCopyQueue<FRAME_SIZE, queue_length> zero_copy;
+	measure("ZeroCopyQueue<512 B> allocate/push/pop", [&] {
+		auto block = zero_copy.allocate();
+		block.as<Frame>()->data[0]++;
+		zero_copy.push(std::move(block));
+		auto received = zero_copy.pop();
+		frame.data[1] = received.as<Frame>()->data[0];
+	});
+}
+
+static void benchmark_message_queue() noexcept
+{
+	constexpr size_t queue_length = 8;
+	int value = 0;
+
+	auto raw = xQueueCreate(queue_length, sizeof(int));
+	measure("raw xQueueSendToBack/Receive", [&] {
+		xQueueSendToBack(raw, &value, portMAX_DELAY);
+		xQueueReceive(raw, &value, portMAX_DELAY);
+	});
+	vQueueDelete(raw);
+
+	os::freertos::StaticMessageQueue<int, queue_length> static_queue;
+	measure("StaticMessageQueue<int>::push/pop", [&] {
+		static_queue.push(value);
+		value = static_queue.pop().value_or(0);
+	});
+
+	auto virt = os::Factory::createMessageQueue<int>(queue_length);
+	measure("VirtualMessageQueue<int>::push/pop", [&] {
+		virt->push(value);
+		value = virt->pop().value_or(0);
+	});
+	delete virt;
+
+	auto pooled =
+		os::freertos::freertosOSFactory_impl::createStaticMessageQueue_impl<int, queue_length>();
+	measure("MessageQueue<int, 8> (inline storage)::push/pop", [&] {
+		pooled->push(value);
+		value = pooled->pop().value_or(0);
+	});
+	os::Factory::destroy(pooled);
+
+	os::freertos::MessageQueue<int> batch_queue(queue_length);
+	int batch[queue_length] = {};
+	measure("MessageQueue<int>::push_n/pop_n (8 items)", [&] {
+		batch_queue.push_n(batch, queue_length);
+		batch_queue.pop_n(batch, queue_length);
+	});
+	// Nothing waits on the queue, so this measures the ISR call path without a context switch
+	measure("MessageQueue<int>::pushFromISR/popFromISR", [&] {
+		os::freertos::IsrYield yield;
+		batch_queue.pushFromISR(value, yield);
+		value = batch_queue.popFromISR(yield).value_or(0);
+	});
+	static os::freertos::SpscRing<int, queue_length> ring;
+	measure("SpscRing<int>::pushFromISR/try_pop", [&] {
+		ring.pushFromISR(value);
+		value = ring.try_pop().value_or(0);
+	});
+	measure("MessageQueue<int>::push/pop (8 items)", [&] {
+		for(auto& v : batch)
+		{
+			batch_queue.push(v);
+		}
+
+		for(auto& v : batch)
+		{
+			v = batch_queue.pop().value_or(0);
+		}
+	});
+
+	benchmark_large_messages();
+}
+
+#pragma mark - Condition Variable -
+
+namespace
+{
+struct PingPong
+{
+	embvm::VirtualConditionVariable* cv;
+	embvm::VirtualMutex* mutex;
+	volatile bool ping = false;
+	volatile bool done = false;
+	TaskHandle_t raw_partner = nullptr;
+	TaskHandle_t raw_benchmark = nullptr;
+};
+
+void cv_partner(void* arg) noexcept
+{
+	auto pp = reinterpret_cast<PingPong*>(arg);
+
+	pp->mutex->lock();
+	while(!pp->done)
+	{
+		while(!pp->ping && !pp->done)
+		{
+			pp->cv->wait(pp->mutex);
+		}
+
+		pp->ping = false;
+		pp->cv->signal();
+	}
+	pp->mutex->unlock();
+
+	idle_thread(nullptr);
+}
+
+void notify_partner(void* arg) noexcept
+{
+	auto pp = reinterpret_cast<PingPong*>(arg);
+
+	while(1)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		xTaskNotifyGive(pp->raw_benchmark);
+	}
+}
+constexpr size_t BROADCAST_WAITERS = 8;
+
+template<typename TMutex>
+struct Broadcast
+{
+	os::freertos::ConditionVariable cv;
+	TMutex mutex;
+	volatile uint32_t generation = 0;
+	volatile size_t arrived = 0;
+	volatile bool done = false;
+};
+
+template<typename TMutex>
+void broadcast_waiter(void* arg) noexcept
+{
+	auto b = reinterpret_cast<Broadcast<TMutex>*>(arg);
+	uint32_t seen = 0;
+
+	b->mutex.lock();
+	while(!b->done)
+	{
+		while(b->generation == seen && !b->done)
+		{
+			b->cv.wait(&b->mutex);
+		}
+
+		seen = b->generation;
+		b->arrived = b->arrived + 1;
+	}
+	b->mutex.unlock();
+
+	idle_thread(nullptr);
+}
+
+/// Time from broadcast() until every waiter has reacquired the mutex.
+template<typename TMutex>
+void measure_broadcast(const char* name) noexcept
+{
+	static Broadcast<TMutex> b;
+	TaskHandle_t waiters[BROADCAST_WAITERS];
+
+	for(auto& w : waiters)
+	{
+		xTaskCreate(broadcast_waiter<TMutex>, "waiter", BENCHMARK_STACK_SIZE / sizeof(StackType_t),
+					&b, BENCHMARK_PRIORITY + 1, &w);
+	}
+
+	measure_manual(name, [](LatencyRecorder& r) {
+		b.mutex.lock();
+		b.arrived = 0;
+		b.generation = b.generation + 1;
+		auto start = clock::now();
+		b.cv.broadcast();
+		b.mutex.unlock();
+
+		// The waiters run at a higher priority, so they have all finished when we get here
+		while(b.arrived < BROADCAST_WAITERS)
+		{
+			taskYIELD();
+		}
+		r.record(clock::now() - start);
+	});
+
+	b.mutex.lock();
+	b.done = true;
+	b.cv.broadcast();
+	b.mutex.unlock();
+
+	for(auto w : waiters)
+	{
+		vTaskDelete(w);
+	}
+	reclaim_deleted_tasks();
+}
+} // namespace
+
+static void benchmark_condition_variable() noexcept
+{
+	PingPong pp;
+	pp.raw_benchmark = xTaskGetCurrentTaskHandle();
+
+	xTaskCreate(notify_partner, "notify", BENCHMARK_STACK_SIZE / sizeof(StackType_t), &pp,
+				BENCHMARK_PRIORITY, &pp.raw_partner);
+	measure("raw task notification round trip", [&] {
+		xTaskNotifyGive(pp.raw_partner);
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	});
+	vTaskDelete(pp.raw_partner);
+
+	pp.cv = os::Factory::createConditionVariable();
+	pp.mutex = os::Factory::createMutex();
+	auto partner = os::Factory::createThread("cv_partner", cv_partner, &pp,
+											 embvm::thread::priority::high, BENCHMARK_STACK_SIZE);
+
+	measure("ConditionVariable signal/wait round trip", [&] {
+		pp.mutex->lock();
+		pp.ping = true;
+		pp.cv->signal();
+		while(pp.ping)
+		{
+			pp.cv->wait(pp.mutex);
+		}
+		pp.mutex->unlock();
+	});
+
+	pp.mutex->lock();
+	pp.done = true;
+	pp.cv->signal();
+	pp.mutex->unlock();
+	reclaim_deleted_tasks();
+
+	os::Factory::destroy(partner);
+	os::Factory::destroy(pp.cv);
+	os::Factory::destroy(pp.mutex);
+	reclaim_deleted_tasks();
+
+	measure_broadcast<os::freertos::Mutex>("ConditionVariable broadcast to 8 waiters (Mutex)");
+	measure_broadcast<os::freertos::FastMutex>(
+		"ConditionVariable broadcast to 8 waiters (FastMutex, requeue)");
+}
+
+#pragma mark - Thread -
+
+static void benchmark_thread() noexcept
+{
+	measure_manual(
+		"raw xTaskCreate/vTaskDelete",
+		[](LatencyRecorder& r) {
+			TaskHandle_t handle;
+			auto start = clock::now();
+			xTaskCreate(idle_thread, "raw", BENCHMARK_STACK_SIZE / sizeof(StackType_t), nullptr,
+						tskIDLE_PRIORITY + 1, &handle);
+			vTaskDelete(handle);
+			r.record(clock::now() - start);
+			reclaim_deleted_tasks();
+		},
+		THREAD_SAMPLE_COUNT);
+
+	measure_manual(
+		"Thread construct/destruct",
+		[](LatencyRecorder& r) {
+			auto start = clock::now();
+			{
+				os::freertos::Thread t("direct", idle_thread, nullptr,
+									   embvm::thread::priority::lowest, BENCHMARK_STACK_SIZE);
+			}
+			r.record(clock::now() - start);
+			reclaim_deleted_tasks();
+		},
+		THREAD_SAMPLE_COUNT);
+
+	measure("this_thread::yield (no other ready task)", [] { embvm::this_thread::yield(); });
+
+	measure_manual(
+		"Thread create suspended/startAll (4 threads)",
+		[](LatencyRecorder& r) {
+			auto start = clock::now();
+			{
+				os::freertos::Thread a("a", idle_thread, nullptr, embvm::thread::priority::lowest,
+									   BENCHMARK_STACK_SIZE, nullptr, true);
+				os::freertos::Thread b("b", idle_thread, nullptr, embvm::thread::priority::lowest,
+									   BENCHMARK_STACK_SIZE, nullptr, true);
+				os::freertos::Thread c("c", idle_thread, nullptr, embvm::thread::priority::lowest,
+									   BENCHMARK_STACK_SIZE, nullptr, true);
+				os::freertos::Thread d("d", idle_thread, nullptr, embvm::thread::priority::lowest,
+									   BENCHMARK_STACK_SIZE, nullptr, true);
+				os::freertos::Thread::startAll({&a, &b, &c, &d});
+			}
+			r.record(clock::now() - start);
+			reclaim_deleted_tasks();
+		},
+		THREAD_SAMPLE_COUNT);
+
+	// The thread runs at a lower priority, so join() has to block until it finishes
+	measure_manual(
+		"Thread create/join (short-lived)",
+		[](LatencyRecorder& r) {
+			auto start = clock::now();
+			{
+				os::freertos::Thread t("joined", [](void*) {}, nullptr,
+									   embvm::thread::priority::lowest, BENCHMARK_STACK_SIZE);
+				t.join();
+			}
+			r.record(clock::now() - start);
+			reclaim_deleted_tasks();
+		},
+		THREAD_SAMPLE_COUNT);
+}
+
+#pragma mark - Executor -
+
+static void benchmark_executor() noexcept
+{
+	static os::freertos::Executor<2> executor(embvm::thread::priority::high,
+											  BENCHMARK_STACK_SIZE);
+	auto self = xTaskGetCurrentTaskHandle();
+
+	// Compare with "Thread create/join (short-lived)"
+	measure("Executor submit/complete round trip", [&] {
+		executor.submit([self] { xTaskNotifyGive(self); });
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	});
+
+	executor.shutdown();
+	reclaim_deleted_tasks();
+}
+
+#pragma mark - Periodic Thread -
+
+namespace
+{
+constexpr size_t PERIOD_SAMPLE_COUNT = 200;
+
+struct PeriodicProbe
+{
+	LatencyRecorder recorder;
+	clock::time_point first{};
+	size_t calls = 0;
+};
+
+/// Record how far each call lands from its ideal time, measured from the first call.
+void periodic_probe(void* arg) noexcept
+{
+	auto probe = reinterpret_cast<PeriodicProbe*>(arg);
+	auto now = clock::now();
+
+	if(probe->calls == 0)
+	{
+		probe->first = now;
+	}
+	else
+	{
+		auto ideal = probe->first + std::chrono::milliseconds(probe->calls);
+		probe->recorder.record(now > ideal ? now - ideal : ideal - now);
+	}
+
+	probe->calls++;
+}
+} // namespace
+
+static void benchmark_periodic_thread() noexcept
+{
+	static PeriodicProbe probe;
+
+	{
+		os::freertos::PeriodicThread periodic("periodic", std::chrono::milliseconds(1),
+											  periodic_probe, &probe,
+											  embvm::thread::priority::veryHigh,
+											  BENCHMARK_STACK_SIZE);
+
+		while(probe.calls <= PERIOD_SAMPLE_COUNT)
+		{
+			vTaskDelay(10);
+		}
+
+		periodic.stop();
+		printf("PeriodicThread 1 ms: %u overruns, %u missed releases, jitter %u ticks\n",
+			   static_cast<unsigned>(periodic.stats().overruns),
+			   static_cast<unsigned>(periodic.stats().missed_releases),
+			   static_cast<unsigned>(periodic.stats().jitter()));
+	}
+
+	probe.recorder.report("PeriodicThread 1 ms drift from ideal time");
+	reclaim_deleted_tasks();
+}
+
+#pragma mark - Factory Pools -
+
+static void benchmark_factory() noexcept
+{
+	measure("Factory create/destroy Mutex", [] {
+		os::Factory::destroy(os::Factory::createMutex());
+	});
+
+	measure("Factory create/destroy Semaphore", [] {
+		os::Factory::destroy(os::Factory::createSemaphore());
+	});
+
+	measure("Factory create/destroy EventFlag", [] {
+		os::Factory::destroy(os::Factory::createEventFlag());
+	});
+
+	measure("Factory create/destroy StaticMutex", [] {
+		using os::freertos::freertosOSFactory_impl;
+		freertosOSFactory_impl::destroy_impl(freertosOSFactory_impl::createStaticMutex_impl());
+	});
+
+	measure("Factory create/destroy ConditionVariable", [] {
+		os::Factory::destroy(os::Factory::createConditionVariable());
+	});
+
+	measure_manual(
+		"Factory create/destroy Thread",
+		[](LatencyRecorder& r) {
+			auto start = clock::now();
+			os::Factory::destroy(os::Factory::createThread("factory", idle_thread, nullptr,
+														   embvm::thread::priority::lowest,
+														   BENCHMARK_STACK_SIZE));
+			r.record(clock::now() - start);
+			reclaim_deleted_tasks();
+		},
+		THREAD_SAMPLE_COUNT);
+}
+
+#pragma mark - Benchmark Runner -
+
+static void benchmark_task(void* arg) noexcept
+{
+	(void)arg;
+
+	LatencyRecorder::print_header();
+	benchmark_mutex();
+	benchmark_semaphore();
+	benchmark_event_flag();
+	benchmark_message_queue();
+	benchmark_condition_variable();
+	benchmark_thread();
+	benchmark_executor();
+	benchmark_periodic_thread();
+	benchmark_factory();
+
+	fflush(stdout);
+	exit(EXIT_SUCCESS);
+}
+
+int main()
+{
+	auto r = xTaskCreate(benchmark_task, "benchmark", BENCHMARK_STACK_SIZE / sizeof(StackType_t),
+						 nullptr, BENCHMARK_PRIORITY, nullptr);
+	if(r != pdPASS)
+	{
+		return EXIT_FAILURE;
+	}
+
+	os::freertos::startScheduler();
+
+	// The scheduler only returns if it could not be started
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,173 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#include "benchmark_harness.hpp"
+#include <FreeRTOS.h>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <heap.hpp>
+#include <task.h>
+
+/**
+ * Latency benchmarks for os::freertos::Heap.
+ *
+ * Heap is built on heap_5, so every Heap operation is paired with the same pvPortMalloc() or
+ * vPortFree() call on the same regions. The report shows what the slab and arena paths save
+ * over the plain heap_5 allocator.
+ */
+
+using namespace benchmark;
+using os::freertos::Heap;
+using os::freertos::HeapRegionType;
+
+#pragma mark - Definitions -
+
+namespace
+{
+constexpr size_t BENCHMARK_STACK_SIZE = 16 * 1024;
+constexpr UBaseType_t BENCHMARK_PRIORITY = freertos_port_priorities::high;
+
+constexpr size_t GENERAL_REGION_SIZE = 512 * 1024;
+constexpr size_t FAST_REGION_SIZE = 32 * 1024;
+
+/// Number of blocks kept allocated by the working set benchmarks
+constexpr size_t WORKING_SET_SIZE = 32;
+
+alignas(portBYTE_ALIGNMENT) uint8_t general_region[GENERAL_REGION_SIZE];
+alignas(portBYTE_ALIGNMENT) uint8_t fast_region[FAST_REGION_SIZE];
+
+/** Allocate and free a block back to back.
+ *
+ * This is the best case for both allocators: the block that was just freed is handed out
+ * again.
+ */
+template<typename TAlloc, typename TFree>
+void alloc_free_pair(const char* name, TAlloc&& alloc, TFree&& free) noexcept
+{
+	measure(name, [&]() {
+		auto p = alloc();
+		assert(p);
+		free(p);
+	});
+}
+
+/** Time alloc() and free() separately while a working set of blocks is live.
+ *
+ * The blocks are freed in allocation order, so heap_5 has to search and coalesce a
+ * fragmented free list instead of reusing the last block.
+ */
+template<typename TAlloc, typename TFree>
+void working_set(const char* alloc_name, const char* free_name, TAlloc&& alloc,
+				 TFree&& free) noexcept
+{
+	void* blocks[WORKING_SET_SIZE];
+	size_t next = 0;
+
+	for(auto& b : blocks)
+	{
+		b = alloc();
+		assert(b);
+	}
+
+	measure_manual(alloc_name, [&](LatencyRecorder& r) {
+		free(blocks[next]);
+		auto start = clock::now();
+		blocks[next] = alloc();
+		r.record(clock::now() - start);
+		assert(blocks[next]);
+		next = (next + 1) % WORKING_SET_SIZE;
+	});
+
+	measure_manual(free_name, [&](LatencyRecorder& r) {
+		auto start = clock::now();
+		free(blocks[next]);
+		r.record(clock::now() - start);
+		blocks[next] = alloc();
+		assert(blocks[next]);
+		next = (next + 1) % WORKING_SET_SIZE;
+	});
+
+	for(auto b : blocks)
+	{
+		free(b);
+	}
+}
+
+} // namespace
+
+#pragma mark - Allocation -
+
+template<size_t TSize>
+static void benchmark_size(const char* heap_name, const char* raw_name) noexcept
+{
+	alloc_free_pair(
+		heap_name, [] { return Heap::alloc(TSize); }, [](void* p) { Heap::free(p); });
+	alloc_free_pair(
+		raw_name, [] { return pvPortMalloc(TSize); }, [](void* p) { vPortFree(p); });
+}
+
+static void benchmark_alloc_free() noexcept
+{
+	benchmark_size<16>("Heap::alloc+free 16 B", "pvPortMalloc+vPortFree 16 B");
+	benchmark_size<64>("Heap::alloc+free 64 B", "pvPortMalloc+vPortFree 64 B");
+	benchmark_size<256>("Heap::alloc+free 256 B", "pvPortMalloc+vPortFree 256 B");
+	benchmark_size<1024>("Heap::alloc+free 1024 B", "pvPortMalloc+vPortFree 1024 B");
+}
+
+static void benchmark_working_set() noexcept
+{
+	working_set(
+		"Heap::alloc 64 B (32 live)", "Heap::free 64 B (32 live)",
+		[] { return Heap::alloc(64); }, [](void* p) { Heap::free(p); });
+	working_set(
+		"pvPortMalloc 64 B (32 live)", "vPortFree 64 B (32 live)", [] { return pvPortMalloc(64); },
+		[](void* p) { vPortFree(p); });
+}
+
+#pragma mark - Tagged Regions -
+
+static void benchmark_regions() noexcept
+{
+	alloc_free_pair(
+		"Heap::alloc+free 64 B fast region", [] { return Heap::alloc(64, HeapRegionType::fast); },
+		[](void* p) { Heap::free(p); });
+	alloc_free_pair(
+		"Heap::alloc_aligned+free 64 B / 32", [] { return Heap::alloc_aligned(64, 32); },
+		[](void* p) { Heap::free(p); });
+}
+
+#pragma mark - Benchmark Runner -
+
+static void benchmark_task(void* arg) noexcept
+{
+	(void)arg;
+
+	LatencyRecorder::print_header();
+	benchmark_alloc_free();
+	benchmark_working_set();
+	benchmark_regions();
+
+	fflush(stdout);
+	exit(EXIT_SUCCESS);
+}
+
+int main()
+{
+	// heap_5 must have its regions before the first pvPortMalloc(), including the kernel's own
+	Heap::addBlock(general_region, sizeof(general_region));
+	Heap::addBlock(fast_region, sizeof(fast_region), HeapRegionType::fast);
+	Heap::init();
+
+	auto r = xTaskCreate(benchmark_task, "benchmark", BENCHMARK_STACK_SIZE / sizeof(StackType_t),
+						 nullptr, BENCHMARK_PRIORITY, nullptr);
+	if(r != pdPASS)
+	{
+		return EXIT_FAILURE;
+	}
+
+	vTaskStartScheduler();
+
+	// The scheduler only returns if it could not be started
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,37 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#include <FreeRTOS.h>
+#include <cstdio>
+#include <cstdlib>
+#include <task.h>
+
+/// Application hooks required by the benchmark FreeRTOSConfig.h, shared by every benchmark.
+
+extern "C" void vAssertCalled(const char* file, unsigned long line)
+{
+	fprintf(stderr, "FreeRTOS assertion failed: %s:%lu\n", file, line);
+	abort();
+}
+
+extern "C" void vApplicationGetIdleTaskMemory(StaticTask_t** tcb, StackType_t** stack,
+											  uint32_t* stack_size)
+{
+	static StaticTask_t idle_tcb;
+	static StackType_t idle_stack[configMINIMAL_STACK_SIZE];
+
+	*tcb = &idle_tcb;
+	*stack = idle_stack;
+	*stack_size = configMINIMAL_STACK_SIZE;
+}
+
+extern "C" void vApplicationGetTimerTaskMemory(StaticTask_t** tcb, StackType_t** stack,
+											   uint32_t* stack_size)
+{
+	static StaticTask_t timer_tcb;
+	static StackType_t timer_stack[configTIMER_TASK_STACK_DEPTH];
+
+	*tcb = &timer_tcb;
+	*stack = timer_stack;
+	*stack_size = configTIMER_TASK_STACK_DEPTH;
+}
@@ -0,0 +1,179 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_BLOCK_POOL_HPP_
+#define FREERTOS_BLOCK_POOL_HPP_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+namespace os::freertos
+{
+namespace details
+{
+/** Lock-free LIFO free list of the indices [0, TCount).
+ *
+ * The head packs a 16-bit modification tag with the 16-bit index of the first free entry,
+ * so both are updated with a single 32-bit compare-exchange. The tag protects against ABA
+ * when a task is preempted in the middle of pop(). pop() and push() are safe to call from any
+ * task or interrupt and never block.
+ *
+ * @tparam TCount The number of indices managed by the list.
+ */
+template<size_t TCount>
+class IndexFreeList
+{
+	static_assert(TCount > 0 && TCount < UINT16_MAX, "IndexFreeList supports 1-65534 entries");
+
+	// Indices are stored +1 so that 0 can mark the end of the list
+	static constexpr uint16_t END = 0;
+
+  public:
+	/// Returned by pop() when the list is empty
+	static constexpr size_t INVALID = TCount;
+
+	/// Construct a list that contains every index
+	IndexFreeList() noexcept
+	{
+		for(size_t i = 0; i < TCount; i++)
+		{
+			next_[i].store(static_cast<uint16_t>((i + 1 < TCount) ? i + 2 : END),
+						   std::memory_order_relaxed);
+		}
+
+		head_.store(pack(0, 1), std::memory_order_release);
+	}
+
+	/// Remove an index from the list. Returns INVALID if the list is empty.
+	size_t pop() noexcept
+	{
+		auto head = head_.load(std::memory_order_acquire);
+
+		while(entry(head) != END)
+		{
+			auto next = next_[entry(head) - 1].load(std::memory_order_relaxed);
+			if(head_.compare_exchange_weak(head, pack(tag(head) + 1, next),
+										   std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				return entry(head) - 1u;
+			}
+		}
+
+		return INVALID;
+	}
+
+	/// Return an index to the list.
+	void push(size_t index) noexcept
+	{
+		assert(index < TCount);
+
+		auto head = head_.load(std::memory_order_relaxed);
+		do
+		{
+			next_[index].store(entry(head), std::memory_order_relaxed);
+		} while(!head_.compare_exchange_weak(
+			head, pack(tag(head) + 1, static_cast<uint16_t>(index + 1)),
+			std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	bool empty() const noexcept
+	{
+		return entry(head_.load(std::memory_order_relaxed)) == END;
+	}
+
+  private:
+	static constexpr uint32_t pack(uint32_t tag, uint16_t entry) noexcept
+	{
+		return (tag << 16) | entry;
+	}
+
+	static constexpr uint16_t entry(uint32_t head) noexcept
+	{
+		return static_cast<uint16_t>(head & 0xFFFF);
+	}
+
+	static constexpr uint32_t tag(uint32_t head) noexcept
+	{
+		return head >> 16;
+	}
+
+  private:
+	std::atomic<uint32_t> head_;
+	std::atomic<uint16_t> next_[TCount];
+};
+} // namespace details
+
+/// @addtogroup FreeRTOSOS
+/// @{
+
+/** Lock-free pool of fixed-size memory blocks.
+ *
+ * allocate() and release() are O(1), never block, and may be called from any task or
+ * interrupt.
+ *
+ * @tparam TBlockSize The usable size of each block in bytes.
+ * @tparam TBlockCount The number of blocks in the pool.
+ */
+template<size_t TBlockSize, size_t TBlockCount>
+class BlockPool
+{
+	static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+	static constexpr size_t STRIDE = ((TBlockSize + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT;
+
+  public:
+	BlockPool() = default;
+	~BlockPool() = default;
+
+	BlockPool(const BlockPool&) = delete;
+	BlockPool& operator=(const BlockPool&) = delete;
+
+	/// Take a block from the pool. Returns nullptr if the pool is exhausted.
+	void* allocate() noexcept
+	{
+		auto index = free_.pop();
+		return (index == decltype(free_)::INVALID) ? nullptr : &storage_[index * STRIDE];
+	}
+
+	/// Return a block to the pool.
+	void release(void* block) noexcept
+	{
+		assert(contains(block));
+		auto offset = static_cast<size_t>(static_cast<uint8_t*>(block) - storage_);
+		assert((offset % STRIDE) == 0);
+		free_.push(offset / STRIDE);
+	}
+
+	/// Check whether a pointer refers to memory owned by this pool.
+	bool contains(const void* ptr) const noexcept
+	{
+		auto p = static_cast<const uint8_t*>(ptr);
+		return p >= storage_ && p < storage_ + sizeof(storage_);
+	}
+
+	bool empty() const noexcept
+	{
+		return free_.empty();
+	}
+
+	static constexpr size_t block_size() noexcept
+	{
+		return TBlockSize;
+	}
+
+	static constexpr size_t block_count() noexcept
+	{
+		return TBlockCount;
+	}
+
+  private:
+	details::IndexFreeList<TBlockCount> free_;
+	alignas(ALIGNMENT) uint8_t storage_[STRIDE * TBlockCount];
+};
+
+/// @}
+
+} // namespace os::freertos
+
+#endif // FREERTOS_BLOCK_POOL_HPP_
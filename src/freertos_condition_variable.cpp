@@ -3,43 +3,118 @@
 
 #include "freertos_condition_variable.hpp"
 #include "freertos_os_helpers.hpp"
-#include "rtos/thread.hpp"
 #include <FreeRTOS.h>
 #include <cassert>
 #include <task.h>
 
 using namespace os::freertos;
+using namespace os::freertos::details;
+
+#if FREERTOS_LOCK_PROFILING
+ConditionVariable::ConditionVariable() noexcept
+{
+	profile_.object = this;
+	profile_.type = LockProfile::kind::condition_variable;
+	LockProfiler::add(&profile_);
+}
+#endif
 
 ConditionVariable::~ConditionVariable() noexcept
 {
-	assert(q_.empty()); // We can't destruct if threads have not been notified!
+	assert(head_ == nullptr); // We can't destruct if threads have not been notified!
+
+#if FREERTOS_LOCK_PROFILING
+	LockProfiler::remove(&profile_);
+#endif
 }
 
-bool ConditionVariable::freertos_wait(embvm::VirtualMutex* mutex, uint32_t ticks_timeout) noexcept
+bool ConditionVariable::freertos_wait(embvm::VirtualMutex* mutex, uintptr_t* lock_word,
+									  TickType_t ticks_timeout) noexcept
 {
-	// We add our function to the waiting queue
-	sem_.take();
-	q_.push(embvm::this_thread::get_handle());
-	sem_.give();
+#if FREERTOS_LOCK_PROFILING
+	uint32_t wait_start = FREERTOS_LOCK_PROFILE_TIMESTAMP();
+#endif
+
+	auto self = xTaskGetCurrentTaskHandle();
+	LockWaiter relock{lock_word,
+					  self,
+					  uxTaskPriorityGet(nullptr),
+					  notify_index::condition_variable,
+					  0,
+					  false,
+					  false,
+					  nullptr};
+	CvWaiter w{self, false, false, lock_word ? &relock : nullptr, nullptr};
 
-	// Tell FreeRTOS to sleep this thread until a notification occurs
-	mutex->unlock();
-	auto r = ulTaskNotifyTake(pdTRUE, ticks_timeout);
-	mutex->lock();
+	taskENTER_CRITICAL();
+	enqueue(&w);
+	taskEXIT_CRITICAL();
+
+	if(mutex)
+	{
+		mutex->unlock();
+	}
+	else
+	{
+		lock_word_unlock(lock_word);
+	}
+
+	TimeOut_t timeout_state;
+	vTaskSetTimeOutState(&timeout_state);
+
+	// Notifications left over from an earlier wait can wake us early, so re-check the node
+	while(!w.notified && xTaskCheckForTimeOut(&timeout_state, &ticks_timeout) == pdFALSE)
+	{
+		ulTaskNotifyTakeIndexed(notify_index::condition_variable, pdTRUE, ticks_timeout);
+	}
+
+	taskENTER_CRITICAL();
+	bool notified = w.notified;
+	if(!notified)
+	{
+		remove(&w);
+	}
+	taskEXIT_CRITICAL();
 
-	return r > 0; // 0 indicates we had no notifications
+#if FREERTOS_LOCK_PROFILING
+	// Every wait blocks, so completed waits count as contended
+	if(notified)
+	{
+		profile_.acquired(wait_start, true);
+	}
+	else
+	{
+		profile_.timed_out(wait_start);
+	}
+#endif
+
+	if(w.requeued)
+	{
+		// broadcast() put us on the mutex's wait list; we own the mutex once we are granted it
+		lock_word_wait_granted(&relock);
+	}
+	else if(mutex)
+	{
+		mutex->lock();
+	}
+	else
+	{
+		lock_word_lock(lock_word);
+	}
+
+	return notified;
 }
 
 bool ConditionVariable::wait(embvm::VirtualMutex* mutex) noexcept
 {
-	return freertos_wait(mutex, portMAX_DELAY);
+	return freertos_wait(mutex, nullptr, portMAX_DELAY);
 }
 
 bool ConditionVariable::wait(embvm::VirtualMutex* mutex,
 							 const embvm::os_timeout_t& timeout) noexcept
 {
 	auto timeout_ticks = frameworkTimeoutToTicks(timeout);
-	return freertos_wait(mutex, timeout_ticks);
+	return freertos_wait(mutex, nullptr, timeout_ticks);
 }
 
 bool ConditionVariable::wait(embvm::VirtualMutex* mutex, const timespec& timeout) noexcept
@@ -47,32 +122,118 @@ bool ConditionVariable::wait(embvm::VirtualMutex* mutex, const timespec& timeout
 	// TODO: improve this approach. it's stupid to go from duration->timespec->duration->uint32_t
 	// Stupid standard implementation.
 	auto timeout_ticks = frameworkTimeoutToTicks(embutil::timespecToDuration(timeout));
-	return freertos_wait(mutex, timeout_ticks);
+	return freertos_wait(mutex, nullptr, timeout_ticks);
+}
+
+bool ConditionVariable::wait(FastMutex* mutex) noexcept
+{
+	return freertos_wait(mutex, reinterpret_cast<uintptr_t*>(mutex->native_handle()),
+						 portMAX_DELAY);
+}
+
+bool ConditionVariable::wait(FastMutex* mutex, const embvm::os_timeout_t& timeout) noexcept
+{
+	return freertos_wait(mutex, reinterpret_cast<uintptr_t*>(mutex->native_handle()),
+						 frameworkTimeoutToTicks(timeout));
+}
+
+bool ConditionVariable::wait(uintptr_t* lock_word, TickType_t ticks_timeout) noexcept
+{
+	assert(lock_word);
+	return freertos_wait(nullptr, lock_word, ticks_timeout);
 }
 
 void ConditionVariable::signal() noexcept
 {
-	sem_.take();
-	if(!q_.empty())
+	taskENTER_CRITICAL();
+	if(head_)
 	{
-		pop_and_notify();
+		notify_head();
 	}
-	sem_.give();
+	taskEXIT_CRITICAL();
 }
 
 void ConditionVariable::broadcast() noexcept
 {
-	sem_.take();
-	while(!q_.empty())
+	taskENTER_CRITICAL();
+	if(head_)
+	{
+		notify_head();
+	}
+
+	while(head_)
+	{
+		if(head_->relock)
+		{
+			requeue_head();
+		}
+		else
+		{
+			notify_head();
+		}
+	}
+	taskEXIT_CRITICAL();
+}
+
+void ConditionVariable::enqueue(CvWaiter* w) noexcept
+{
+	if(tail_)
+	{
+		tail_->next = w;
+	}
+	else
+	{
+		head_ = w;
+	}
+
+	tail_ = w;
+}
+
+void ConditionVariable::remove(CvWaiter* w) noexcept
+{
+	CvWaiter* prev = nullptr;
+
+	for(CvWaiter* it = head_; it; prev = it, it = it->next)
+	{
+		if(it == w)
+		{
+			(prev ? prev->next : head_) = w->next;
+			if(tail_ == w)
+			{
+				tail_ = prev;
+			}
+
+			return;
+		}
+	}
+}
+
+void ConditionVariable::notify_head() noexcept
+{
+	CvWaiter* w = head_;
+	head_ = w->next;
+	if(!head_)
 	{
-		pop_and_notify();
+		tail_ = nullptr;
 	}
-	sem_.give();
+
+	// The node may go out of scope as soon as the critical section ends, so copy what we need
+	auto task = w->task;
+	w->notified = true;
+	xTaskNotifyGiveIndexed(task, notify_index::condition_variable);
 }
 
-void ConditionVariable::pop_and_notify() noexcept
+void ConditionVariable::requeue_head() noexcept
 {
-	embvm::thread::handle_t thread_handle = q_.front();
-	q_.pop();
-	xTaskNotifyGive((reinterpret_cast<TaskHandle_t>(thread_handle)));
+	CvWaiter* w = head_;
+	head_ = w->next;
+	if(!head_)
+	{
+		tail_ = nullptr;
+	}
+
+	// The waiter stays blocked until the mutex is handed to it
+	w->requeued = true;
+	w->notified = true;
+	lock_word_requeue(w->relock);
 }
@@ -4,59 +4,104 @@
 #ifndef FREERTOS_CONDITION_VARIABLE_HPP_
 #define FREERTOS_CONDITION_VARIABLE_HPP_
 
-#include "freertos_semaphore.hpp"
+#include "freertos_fast_mutex.hpp"
+#include "freertos_lock_profiler.hpp"
+#include <FreeRTOS.h>
 #include <ctime>
-#include <etl/queue.h>
-#include <queue>
 #include <rtos/condition_variable.hpp>
 #include <rtos/rtos_defs.hpp>
-// TODO: #include <platform_os_options.hpp>
+#include <task.h>
 
-// If you set this to 0, dynamic allocation will be used
-#ifndef FREERTOS_NUM_THREADS_PER_CV
-#define FREERTOS_NUM_THREADS_PER_CV 0
-#endif
+namespace os::freertos
+{
+namespace details
+{
+/// A task blocked on a condition variable. Waiters live on the blocked task's stack.
+struct CvWaiter
+{
+	TaskHandle_t task;
+	/// Set when the waiter has been removed from the list by signal() or broadcast()
+	volatile bool notified;
+	/// Set when broadcast() moved the waiter onto the mutex's wait list instead of waking it
+	volatile bool requeued;
+	/// Wait list entry for the mutex, or nullptr if the mutex is not a lock word
+	LockWaiter* relock;
+	CvWaiter* next;
+};
+} // namespace details
 
 /** FreeRTOS Condition Variable Implementation
  *
- * FreeRTOS does not provide a CV primitive, so we need to implement the logic using
- * a function queue and a semaphore.
- *
- * The approach used below is taken from this article by Microsoft Research:
- *	https://www.microsoft.com/en-us/research/wp-content/uploads/2004/12/ImplementingCVs.pdf
+ * FreeRTOS does not provide a CV primitive. Each waiting task links a node on its own stack into
+ * the CV's FIFO wait list and blocks on a task notification. The list is only modified inside
+ * a short kernel critical section, so waiting and notifying never allocate memory and do not
+ * need a second kernel object.
  *
+ * When the mutex is a FastMutex, broadcast() wakes only the first waiter and moves the others
+ * directly onto the mutex's wait list (wait morphing). Each of them wakes up already owning the
+ * mutex, one at a time, instead of every waiter waking at once and going back to sleep on the
+ * mutex. Waiters on other mutex types are all woken.
  */
-namespace os::freertos
-{
 class ConditionVariable final : public embvm::VirtualConditionVariable
 {
-	using TQueueType = typename std::conditional<
-		(FREERTOS_NUM_THREADS_PER_CV == 0), std::queue<embvm::thread::handle_t>,
-		etl::queue<embvm::thread::handle_t, FREERTOS_NUM_THREADS_PER_CV>>::type;
-
   public:
+#if FREERTOS_LOCK_PROFILING
+	ConditionVariable() noexcept;
+#else
 	ConditionVariable() = default;
+#endif
 	~ConditionVariable() noexcept;
 
 	bool wait(embvm::VirtualMutex* mutex) noexcept final;
 	bool wait(embvm::VirtualMutex* mutex, const embvm::os_timeout_t& timeout) noexcept final;
 	bool wait(embvm::VirtualMutex* mutex, const timespec& timeout) noexcept;
 
+	/// @name FastMutex waits
+	/// These overloads allow broadcast() to requeue waiters onto the mutex.
+	///@{
+	bool wait(FastMutex* mutex) noexcept;
+	bool wait(FastMutex* mutex, const embvm::os_timeout_t& timeout) noexcept;
+	///@}
+
+	/** Wait on a mutex that is represented by a bare FastMutex lock word.
+	 *
+	 * Used by the libcpp threading layer, which stores std::mutex as a lock word.
+	 */
+	bool wait(uintptr_t* lock_word, TickType_t ticks_timeout = portMAX_DELAY) noexcept;
+
 	void signal() noexcept final;
 	void broadcast() noexcept final;
 
 	embvm::cv::handle_t native_handle() const noexcept final
 	{
-		return sem_.native_handle();
+		return reinterpret_cast<embvm::cv::handle_t>(const_cast<ConditionVariable*>(this));
+	}
+
+#if FREERTOS_LOCK_PROFILING
+	/// Contention statistics for this instance. Set `name` to label it in dumps.
+	LockProfile& profile() noexcept
+	{
+		return profile_;
 	}
+#endif
 
   private:
-	bool freertos_wait(embvm::VirtualMutex* mutex, uint32_t ticks_timeout) noexcept;
-	void pop_and_notify() noexcept;
+	bool freertos_wait(embvm::VirtualMutex* mutex, uintptr_t* lock_word,
+					   TickType_t ticks_timeout) noexcept;
+
+	// The list functions must be called inside a critical section
+	void enqueue(details::CvWaiter* w) noexcept;
+	void remove(details::CvWaiter* w) noexcept;
+	void notify_head() noexcept;
+	void requeue_head() noexcept;
 
   private:
-	os::freertos::Semaphore sem_{embvm::semaphore::mode::binary};
-	TQueueType q_;
+	details::CvWaiter* head_ = nullptr;
+	details::CvWaiter* tail_ = nullptr;
+
+#if FREERTOS_LOCK_PROFILING
+	LockProfile profile_;
+#endif
 };
 
 } // namespace os::freertos
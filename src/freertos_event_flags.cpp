@@ -8,26 +8,17 @@
 #include <event_groups.h>
 
 #if configSUPPORT_DYNAMIC_ALLOCATION == 0
-#include <etl/pool.h>
+#include "freertos_object_pool.hpp"
 
 #ifndef FREERTOS_EVENT_GROUP_POOL_COUNT
 #define FREERTOS_EVENT_GROUP_POOL_COUNT 1
 #endif
 
 #if FREERTOS_EVENT_GROUP_POOL_COUNT
-etl::pool<StaticEventGroup_t, FREERTOS_EVENT_GROUP_POOL_COUNT> static_event_pool_;
+os::freertos::LockFreePool<StaticEventGroup_t, FREERTOS_EVENT_GROUP_POOL_COUNT> static_event_pool_;
 #endif
 #endif
 
-namespace
-{
-#if configUSE_16_BIT_TICKS == 1
-constexpr embvm::eventflag::flag_t MAX_SUPPORTED_BITS = (1 << 9);
-#else
-constexpr embvm::eventflag::flag_t MAX_SUPPORTED_BITS = (1 << 24);
-#endif
-}; // namespace
-
 using namespace os::freertos;
 
 EventFlag::~EventFlag() noexcept
@@ -35,7 +26,7 @@ EventFlag::~EventFlag() noexcept
 	vEventGroupDelete(reinterpret_cast<EventGroupHandle_t>(handle_));
 
 #if configSUPPORT_DYNAMIC_ALLOCATION == 0
-	static_event_pool_.release(reinterpret_cast<StaticEventGroup_t*>(handle_));
+	static_event_pool_.destroy(reinterpret_cast<StaticEventGroup_t*>(handle_));
 #endif
 }
 
@@ -46,7 +37,7 @@ EventFlag::EventFlag() noexcept
 	handle_ = reinterpret_cast<embvm::eventflag::handle_t>(xEventGroupCreate());
 	assert(handle_);
 #else
-	auto buf = static_event_pool_.allocate<StaticEventGroup_t>();
+	auto buf = static_event_pool_.create();
 	// cppcheck-suppress useInitializationList
 	handle_ = reinterpret_cast<embvm::eventflag::handle_t>(xEventGroupCreateStatic(buf));
 #endif
@@ -59,7 +50,7 @@ embvm::eventflag::flag_t EventFlag::get(embvm::eventflag::flag_t bits_wait,
 	bool wait_for_all_bits = opt == embvm::eventflag::option::AND;
 	TickType_t timeout_converted = frameworkTimeoutToTicks(timeout);
 
-	assert(bits_wait < MAX_SUPPORTED_BITS);
+	assert(bits_wait < EVENT_FLAG_MAX_SUPPORTED_BITS);
 
 	auto set_bits = xEventGroupWaitBits(reinterpret_cast<EventGroupHandle_t>(handle_), bits_wait,
 										clearOnExit, wait_for_all_bits, timeout_converted);
@@ -69,24 +60,29 @@ embvm::eventflag::flag_t EventFlag::get(embvm::eventflag::flag_t bits_wait,
 
 void EventFlag::set(embvm::eventflag::flag_t bits) noexcept
 {
-	assert(bits < MAX_SUPPORTED_BITS);
+	assert(bits < EVENT_FLAG_MAX_SUPPORTED_BITS);
 
 	xEventGroupSetBits(reinterpret_cast<EventGroupHandle_t>(handle_), bits);
 }
 
 void EventFlag::setFromISR(embvm::eventflag::flag_t bits) noexcept
 {
-	assert(bits < MAX_SUPPORTED_BITS);
+	IsrYield yield;
+	setFromISR(bits, yield);
+}
 
-	BaseType_t higher_priority_task_woken;
-	auto r = xEventGroupSetBitsFromISR(reinterpret_cast<EventGroupHandle_t>(handle_), bits,
-									   &higher_priority_task_woken);
-	assert(r == pdTRUE);
+void EventFlag::setFromISR(embvm::eventflag::flag_t bits, IsrYield& yield) noexcept
+{
+	assert(bits < EVENT_FLAG_MAX_SUPPORTED_BITS);
 
-	portYIELD_FROM_ISR(higher_priority_task_woken);
+	[[maybe_unused]] auto r =
+		xEventGroupSetBitsFromISR(reinterpret_cast<EventGroupHandle_t>(handle_), bits,
+								  yield.woken());
+	assert(r == pdTRUE);
 }
 
 void EventFlag::clear() noexcept
 {
-	xEventGroupClearBits(reinterpret_cast<EventGroupHandle_t>(handle_), MAX_SUPPORTED_BITS - 1);
+	xEventGroupClearBits(reinterpret_cast<EventGroupHandle_t>(handle_),
+						 EVENT_FLAG_MAX_SUPPORTED_BITS - 1);
 }
@@ -4,6 +4,7 @@
 #ifndef FREERTOS_EVENT_FLAGS_HPP_
 #define FREERTOS_EVENT_FLAGS_HPP_
 
+#include "freertos_os_helpers.hpp"
 #include <rtos/event_flag.hpp>
 #include <string_view>
 
@@ -31,6 +32,8 @@ class EventFlag final : public embvm::VirtualEventFlag
 	void set(embvm::eventflag::flag_t bits) noexcept final;
 
 	void setFromISR(embvm::eventflag::flag_t bits) noexcept final;
+	/// Set flags from an interrupt, deferring the context switch to `yield`.
+	void setFromISR(embvm::eventflag::flag_t bits, IsrYield& yield) noexcept;
 
 	void clear() noexcept final;
 
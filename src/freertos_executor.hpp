@@ -0,0 +1,368 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_EXECUTOR_HPP_
+#define FREERTOS_EXECUTOR_HPP_
+
+#include "freertos_os_helpers.hpp"
+#include "freertos_thread.hpp"
+#include <FreeRTOS.h>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <task.h>
+#include <type_traits>
+
+/**
+ * Your application can define this macro to change the inline storage available to each
+ * Executor job. Callables that do not fit are rejected at compile time.
+ */
+#ifndef FREERTOS_EXECUTOR_JOB_SIZE
+#define FREERTOS_EXECUTOR_JOB_SIZE (4 * sizeof(void*))
+#endif
+
+namespace os::freertos
+{
+namespace details
+{
+/// A type-erased callable stored inline. Only trivially copyable callables are supported.
+class ExecutorJob
+{
+  public:
+	ExecutorJob() = default;
+
+	template<typename TFunctor>
+	explicit ExecutorJob(const TFunctor& f) noexcept : invoke_(&call<TFunctor>)
+	{
+		static_assert(sizeof(TFunctor) <= FREERTOS_EXECUTOR_JOB_SIZE,
+					  "Job does not fit; increase FREERTOS_EXECUTOR_JOB_SIZE");
+		static_assert(alignof(TFunctor) <= alignof(std::max_align_t));
+		static_assert(std::is_trivially_copyable<TFunctor>::value,
+					  "Executor jobs must be trivially copyable");
+		new(storage_) TFunctor(f);
+	}
+
+	void operator()() noexcept
+	{
+		invoke_(storage_);
+	}
+
+  private:
+	template<typename TFunctor>
+	static void call(void* storage) noexcept
+	{
+		(*reinterpret_cast<TFunctor*>(storage))();
+	}
+
+  private:
+	void (*invoke_)(void*) = nullptr;
+	alignas(std::max_align_t) uint8_t storage_[FREERTOS_EXECUTOR_JOB_SIZE];
+};
+
+/** Fixed-capacity work deque.
+ *
+ * The owning worker pushes and pops at the bottom, so it runs its newest job first while it is
+ * still cache-warm. Idle workers steal from the top, taking the oldest job.
+ *
+ * The caller must hold a critical section.
+ */
+template<size_t TDepth>
+class WorkDeque
+{
+  public:
+	bool push_bottom(const ExecutorJob& job) noexcept
+	{
+		if(bottom_ - top_ == TDepth)
+		{
+			return false;
+		}
+
+		jobs_[bottom_++ % TDepth] = job;
+		return true;
+	}
+
+	bool pop_bottom(ExecutorJob& job) noexcept
+	{
+		if(empty())
+		{
+			return false;
+		}
+
+		job = jobs_[--bottom_ % TDepth];
+		return true;
+	}
+
+	bool steal_top(ExecutorJob& job) noexcept
+	{
+		if(empty())
+		{
+			return false;
+		}
+
+		job = jobs_[top_++ % TDepth];
+		return true;
+	}
+
+	bool empty() const noexcept
+	{
+		return top_ == bottom_;
+	}
+
+  private:
+	ExecutorJob jobs_[TDepth];
+	size_t top_ = 0;
+	size_t bottom_ = 0;
+};
+} // namespace details
+
+/// @addtogroup FreeRTOSOS
+/// @{
+
+/** Runs small jobs on a fixed set of worker threads.
+ *
+ * Each worker has its own deque. Jobs submitted from outside the executor are spread across
+ * the workers round-robin. Jobs submitted from a worker go to that worker's deque. A worker
+ * with an empty deque steals from the others, and parks on a task notification when there is
+ * no work anywhere. Submitting a job wakes a parked worker.
+ *
+ * Jobs are function pointer and context pairs, or trivially copyable callables of up to
+ * FREERTOS_EXECUTOR_JOB_SIZE bytes. Jobs run in no particular order.
+ *
+ * @code
+ * os::freertos::Executor<4> executor(embvm::thread::priority::normal, 2048);
+ * executor.submit(handle_request, &request);
+ * executor.submit([&sensor] { sensor.sample(); });
+ * @endcode
+ *
+ * @tparam TWorkers The number of worker threads.
+ * @tparam TQueueDepth The number of jobs each worker's deque can hold.
+ */
+template<size_t TWorkers, size_t TQueueDepth = 16>
+class Executor
+{
+	static_assert(TWorkers > 0 && TWorkers <= 32, "Executor supports 1-32 workers");
+	static_assert(TQueueDepth > 0, "Executor deques must hold at least one job");
+
+	struct Worker
+	{
+		Executor* owner;
+		size_t index;
+		TaskHandle_t task;
+		details::WorkDeque<TQueueDepth> deque;
+	};
+
+  public:
+	/** Create the executor and start its workers.
+	 *
+	 * @param p The priority of the worker threads.
+	 * @param stack_size The stack size of each worker thread.
+	 */
+	explicit Executor(embvm::thread::priority p = embvm::thread::priority::normal,
+					  size_t stack_size = FREERTOS_STACK_MIN) noexcept
+	{
+		Thread* threads[TWorkers];
+
+		for(size_t i = 0; i < TWorkers; i++)
+		{
+			workers_[i].owner = this;
+			workers_[i].index = i;
+			threads_[i].emplace("executor", worker_main, &workers_[i], p, stack_size, nullptr,
+								true);
+			workers_[i].task = reinterpret_cast<TaskHandle_t>(threads_[i]->native_handle());
+			threads[i] = &*threads_[i];
+		}
+
+		// Every worker handle is recorded before any worker can look for work
+		Thread::startAll(threads, TWorkers);
+	}
+
+	/// Runs the queued jobs, then stops the workers.
+	~Executor() noexcept
+	{
+		shutdown();
+	}
+
+	Executor(const Executor&) = delete;
+	Executor& operator=(const Executor&) = delete;
+
+	/** Queue a callable.
+	 *
+	 * Never blocks.
+	 *
+	 * @returns false if every deque is full or the executor has been shut down.
+	 */
+	template<typename TFunctor>
+	bool submit(const TFunctor& f) noexcept
+	{
+		details::ExecutorJob job(f);
+		size_t self = current_worker();
+		bool queued = false;
+
+		taskENTER_CRITICAL();
+		size_t start = (self < TWorkers) ? self : (next_++ % TWorkers);
+
+		for(size_t i = 0; i < TWorkers && !stop_; i++)
+		{
+			auto target = (start + i) % TWorkers;
+			if(workers_[target].deque.push_bottom(job))
+			{
+				queued = true;
+				wake_one(target);
+				break;
+			}
+		}
+		taskEXIT_CRITICAL();
+
+		return queued;
+	}
+
+	/// Queue a function pointer and its context.
+	bool submit(void (*func)(void*), void* ctx) noexcept
+	{
+		return submit([func, ctx] { func(ctx); });
+	}
+
+	/// Run the queued jobs, then stop and join every worker. Further submissions fail.
+	void shutdown() noexcept
+	{
+		taskENTER_CRITICAL();
+		stop_ = true;
+		while(parked_)
+		{
+			wake_one(0);
+		}
+		taskEXIT_CRITICAL();
+
+		for(auto& t : threads_)
+		{
+			if(t)
+			{
+				t->join();
+				t.reset();
+			}
+		}
+	}
+
+	static constexpr size_t worker_count() noexcept
+	{
+		return TWorkers;
+	}
+
+  private:
+	/// Returns the index of the calling worker, or TWorkers if the caller is not a worker.
+	size_t current_worker() const noexcept
+	{
+		auto self = xTaskGetCurrentTaskHandle();
+
+		for(size_t i = 0; i < TWorkers; i++)
+		{
+			if(workers_[i].task == self)
+			{
+				return i;
+			}
+		}
+
+		return TWorkers;
+	}
+
+	/// Take a job from the worker's own deque, or steal one. Call inside a critical section.
+	bool next_job(Worker& w, details::ExecutorJob& job) noexcept
+	{
+		if(w.deque.pop_bottom(job))
+		{
+			return true;
+		}
+
+		for(size_t i = 1; i < TWorkers; i++)
+		{
+			if(workers_[(w.index + i) % TWorkers].deque.steal_top(job))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/// Wake a parked worker, preferring `preferred`. Call inside a critical section.
+	void wake_one(size_t preferred) noexcept
+	{
+		if(!parked_)
+		{
+			return;
+		}
+
+		uint32_t bit = 1u << preferred;
+		if(!(parked_ & bit))
+		{
+			// Lowest set bit
+			bit = parked_ & (~parked_ + 1);
+		}
+
+		parked_ &= ~bit;
+		for(size_t i = 0; i < TWorkers; i++)
+		{
+			if(bit == (1u << i))
+			{
+				xTaskNotifyGiveIndexed(workers_[i].task, notify_index::executor);
+				break;
+			}
+		}
+	}
+
+	static void worker_main(void* worker) noexcept
+	{
+		auto w = reinterpret_cast<Worker*>(worker);
+		auto exec = w->owner;
+		uint32_t bit = 1u << w->index;
+		details::ExecutorJob job;
+
+		while(1)
+		{
+			taskENTER_CRITICAL();
+			bool found = exec->next_job(*w, job);
+			bool stop = exec->stop_;
+			if(found || stop)
+			{
+				exec->parked_ &= ~bit;
+			}
+			else
+			{
+				// Parking inside the same critical section as the empty check means a submit
+				// cannot slip in between and miss us
+				exec->parked_ |= bit;
+			}
+			taskEXIT_CRITICAL();
+
+			if(found)
+			{
+				job();
+			}
+			else if(stop)
+			{
+				break;
+			}
+			else
+			{
+				ulTaskNotifyTakeIndexed(notify_index::executor, pdTRUE, portMAX_DELAY);
+			}
+		}
+	}
+
+  private:
+	Worker workers_[TWorkers] = {};
+	std::optional<Thread> threads_[TWorkers];
+	/// Bit i is set while worker i is parked
+	uint32_t parked_ = 0;
+	/// Round-robin target for jobs submitted from outside the executor
+	size_t next_ = 0;
+	volatile bool stop_ = false;
+};
+
+/// @}
+
+} // namespace os::freertos
+
+#endif // FREERTOS_EXECUTOR_HPP_
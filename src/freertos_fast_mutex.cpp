@@ -0,0 +1,274 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#include "freertos_fast_mutex.hpp"
+#include "freertos_os_helpers.hpp"
+#include <FreeRTOS.h>
+#include <algorithm>
+#include <cassert>
+#include <task.h>
+
+using namespace os::freertos;
+using namespace os::freertos::details;
+
+#pragma mark - Definitions -
+
+/**
+ * Your application can define this macro to change the number of wait list buckets.
+ * Waiters for different lock words share a bucket, so more buckets shorten the list walks
+ * performed in the contended paths.
+ */
+#ifndef FREERTOS_LOCK_WAIT_BUCKETS
+#define FREERTOS_LOCK_WAIT_BUCKETS 8
+#endif
+
+static_assert(INCLUDE_vTaskPrioritySet && INCLUDE_uxTaskPriorityGet,
+			  "FastMutex priority inheritance requires INCLUDE_vTaskPrioritySet and "
+			  "INCLUDE_uxTaskPriorityGet");
+
+#pragma mark - Wait Lists -
+
+// All wait list functions must be called inside a critical section. On a single core this
+// also means the lock word cannot change underneath us, so plain atomic loads and stores are
+// enough to update it.
+namespace
+{
+LockWaiter* wait_buckets_[FREERTOS_LOCK_WAIT_BUCKETS];
+
+LockWaiter*& bucket(const uintptr_t* word) noexcept
+{
+	return wait_buckets_[(reinterpret_cast<uintptr_t>(word) / sizeof(uintptr_t)) %
+						 FREERTOS_LOCK_WAIT_BUCKETS];
+}
+
+TaskHandle_t owner_task(uintptr_t value) noexcept
+{
+	value &= ~LOCK_WORD_WAITERS;
+	return (value == LOCK_WORD_NO_TASK) ? nullptr : reinterpret_cast<TaskHandle_t>(value);
+}
+
+void enqueue(LockWaiter* w) noexcept
+{
+	LockWaiter** tail = &bucket(w->word);
+	while(*tail)
+	{
+		tail = &(*tail)->next;
+	}
+
+	w->next = nullptr;
+	*tail = w;
+}
+
+void remove(LockWaiter* w) noexcept
+{
+	for(LockWaiter** it = &bucket(w->word); *it; it = &(*it)->next)
+	{
+		if(*it == w)
+		{
+			*it = w->next;
+			w->next = nullptr;
+			return;
+		}
+	}
+}
+
+/// Find the highest priority waiter for a word. Ties go to the longest waiter.
+LockWaiter* highest_waiter(const uintptr_t* word) noexcept
+{
+	LockWaiter* best = nullptr;
+
+	for(LockWaiter* w = bucket(word); w; w = w->next)
+	{
+		if(w->word == word && (!best || w->priority > best->priority))
+		{
+			best = w;
+		}
+	}
+
+	return best;
+}
+
+/// Raise the owner to the waiter's priority if the owner is running below it.
+void boost_owner(TaskHandle_t owner, LockWaiter* w) noexcept
+{
+	if(!owner || !w)
+	{
+		return;
+	}
+
+	auto owner_priority = uxTaskPriorityGet(owner);
+	if(owner_priority < w->priority)
+	{
+		w->restore_priority = owner_priority;
+		w->boosted = true;
+		vTaskPrioritySet(owner, w->priority);
+	}
+}
+
+/// Undo every priority boost applied to the owner of a word.
+void restore_owner(TaskHandle_t owner, const uintptr_t* word) noexcept
+{
+	bool boosted = false;
+	UBaseType_t restore = 0;
+
+	for(LockWaiter* w = bucket(word); w; w = w->next)
+	{
+		if(w->word == word && w->boosted)
+		{
+			// Boosts only ever raise the priority, so the lowest saved value is the original
+			restore = boosted ? std::min(restore, w->restore_priority) : w->restore_priority;
+			boosted = true;
+			w->boosted = false;
+		}
+	}
+
+	if(owner && boosted)
+	{
+		vTaskPrioritySet(owner, restore);
+	}
+}
+
+/// Remove a waiter that timed out, keeping the owner's inherited priority consistent.
+void abandon(LockWaiter* w) noexcept
+{
+	remove(w);
+
+	auto value = __atomic_load_n(w->word, __ATOMIC_RELAXED);
+	auto owner = owner_task(value);
+	LockWaiter* next = highest_waiter(w->word);
+
+	if(!next)
+	{
+		__atomic_store_n(w->word, value & ~LOCK_WORD_WAITERS, __ATOMIC_RELAXED);
+	}
+
+	if(w->boosted && owner)
+	{
+		// Drop the owner back to the priority it had before this waiter raised it, then let the
+		// remaining waiters raise it again if they need to.
+		vTaskPrioritySet(owner, w->restore_priority);
+		boost_owner(owner, next);
+	}
+}
+
+bool wait_for_grant(LockWaiter* w, TickType_t timeout) noexcept
+{
+	TimeOut_t timeout_state;
+	vTaskSetTimeOutState(&timeout_state);
+
+	while(!w->granted)
+	{
+		if(xTaskCheckForTimeOut(&timeout_state, &timeout) == pdTRUE)
+		{
+			taskENTER_CRITICAL();
+			bool granted = w->granted;
+			if(!granted)
+			{
+				abandon(w);
+			}
+			taskEXIT_CRITICAL();
+
+			return granted;
+		}
+
+		ulTaskNotifyTakeIndexed(w->notify_index, pdFALSE, timeout);
+	}
+
+	return true;
+}
+} // namespace
+
+#pragma mark - Lock Word Slow Paths -
+
+bool os::freertos::details::lock_word_lock_slow(uintptr_t* word, TickType_t timeout) noexcept
+{
+	LockWaiter w{word,
+				 xTaskGetCurrentTaskHandle(),
+				 uxTaskPriorityGet(nullptr),
+				 notify_index::lock,
+				 0,
+				 false,
+				 false,
+				 nullptr};
+
+	taskENTER_CRITICAL();
+
+	// The owner may have released the lock before we entered the critical section
+	auto value = __atomic_load_n(word, __ATOMIC_RELAXED);
+	if(value == LOCK_WORD_UNLOCKED || timeout == 0)
+	{
+		bool acquired = value == LOCK_WORD_UNLOCKED;
+		if(acquired)
+		{
+			__atomic_store_n(word, lock_word_self(), __ATOMIC_RELAXED);
+		}
+
+		taskEXIT_CRITICAL();
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		return acquired;
+	}
+
+	__atomic_store_n(word, value | LOCK_WORD_WAITERS, __ATOMIC_RELAXED);
+	enqueue(&w);
+	boost_owner(owner_task(value), &w);
+
+	taskEXIT_CRITICAL();
+
+	bool acquired = wait_for_grant(&w, timeout);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return acquired;
+}
+
+void os::freertos::details::lock_word_requeue(LockWaiter* w) noexcept
+{
+	auto value = __atomic_load_n(w->word, __ATOMIC_RELAXED);
+	if(value == LOCK_WORD_UNLOCKED)
+	{
+		__atomic_store_n(w->word, reinterpret_cast<uintptr_t>(w->task), __ATOMIC_RELAXED);
+		w->granted = true;
+		xTaskNotifyGiveIndexed(w->task, w->notify_index);
+		return;
+	}
+
+	__atomic_store_n(w->word, value | LOCK_WORD_WAITERS, __ATOMIC_RELAXED);
+	enqueue(w);
+	boost_owner(owner_task(value), w);
+}
+
+void os::freertos::details::lock_word_wait_granted(LockWaiter* w) noexcept
+{
+	[[maybe_unused]] auto granted = wait_for_grant(w, portMAX_DELAY);
+	assert(granted);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+void os::freertos::details::lock_word_unlock_slow(uintptr_t* word) noexcept
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	taskENTER_CRITICAL();
+
+	restore_owner(xTaskGetCurrentTaskHandle(), word);
+
+	LockWaiter* next = highest_waiter(word);
+	if(next)
+	{
+		remove(next);
+
+		LockWaiter* remaining = highest_waiter(word);
+		__atomic_store_n(word,
+						 reinterpret_cast<uintptr_t>(next->task) |
+							 (remaining ? LOCK_WORD_WAITERS : 0),
+						 __ATOMIC_RELAXED);
+		boost_owner(next->task, remaining);
+
+		next->granted = true;
+		xTaskNotifyGiveIndexed(next->task, next->notify_index);
+	}
+	else
+	{
+		__atomic_store_n(word, LOCK_WORD_UNLOCKED, __ATOMIC_RELAXED);
+	}
+
+	taskEXIT_CRITICAL();
+}
@@ -0,0 +1,221 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_FAST_MUTEX_HPP_
+#define FREERTOS_FAST_MUTEX_HPP_
+
+#include <FreeRTOS.h>
+#include <cassert>
+#include <cstdint>
+#include <rtos/mutex.hpp>
+#include <task.h>
+
+namespace os::freertos
+{
+namespace details
+{
+/** Lock word operations.
+ *
+ * A lock word is a single pointer-sized integer. Zero means unlocked. Otherwise it holds the
+ * owning task's handle, with the low bit set when other tasks are waiting for the lock.
+ * Task control blocks are at least 4-byte aligned, so the low bit is always free.
+ *
+ * The uncontended paths are a single compare-exchange on the word and never enter the kernel.
+ * Contended waiters are parked in a small hash table keyed by the word's address and block on
+ * a task notification. Ownership is handed directly to the highest priority waiter on unlock.
+ *
+ * GCC atomic builtins are used so that a lock word can be a plain integer.
+ */
+constexpr uintptr_t LOCK_WORD_UNLOCKED = 0;
+constexpr uintptr_t LOCK_WORD_WAITERS = 0x1;
+/// Owner value used when the lock is taken before the scheduler has created any tasks
+constexpr uintptr_t LOCK_WORD_NO_TASK = 0x2;
+
+/// A task blocked on a lock word. Waiters live on the blocked task's stack.
+struct LockWaiter
+{
+	/// The lock word this task is waiting for
+	uintptr_t* word;
+	TaskHandle_t task;
+	UBaseType_t priority;
+	/// The notification index used to wake this task
+	UBaseType_t notify_index;
+	/// The owner's priority before this waiter raised it
+	UBaseType_t restore_priority;
+	/// True if this waiter raised the owner's priority
+	bool boosted;
+	/// Set when ownership of the lock has been handed to this waiter
+	volatile bool granted;
+	LockWaiter* next;
+};
+
+inline uintptr_t lock_word_self() noexcept
+{
+	auto self = reinterpret_cast<uintptr_t>(xTaskGetCurrentTaskHandle());
+	return self ? self : LOCK_WORD_NO_TASK;
+}
+
+inline uintptr_t lock_word_owner(const uintptr_t* word) noexcept
+{
+	return __atomic_load_n(word, __ATOMIC_RELAXED) & ~LOCK_WORD_WAITERS;
+}
+
+inline bool lock_word_trylock(uintptr_t* word) noexcept
+{
+	uintptr_t expected = LOCK_WORD_UNLOCKED;
+	return __atomic_compare_exchange_n(word, &expected, lock_word_self(), false,
+									   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/** Block until the lock word is acquired or the timeout expires.
+ *
+ * Called after lock_word_trylock() fails. Raises the owner's priority to the caller's
+ * priority while the caller is blocked.
+ *
+ * @param word The lock word.
+ * @param timeout The maximum number of ticks to wait. portMAX_DELAY waits forever.
+ * @returns true if the lock was acquired, false on timeout.
+ */
+bool lock_word_lock_slow(uintptr_t* word, TickType_t timeout) noexcept;
+
+/** Release a lock word that has waiters.
+ *
+ * Ownership is handed to the highest priority waiter, and the caller's priority is restored
+ * if a waiter raised it.
+ */
+void lock_word_unlock_slow(uintptr_t* word) noexcept;
+
+/** Move a task that is blocked on another object onto a lock word's wait list.
+ *
+ * If the lock is free, ownership is granted immediately and the waiter is notified. Otherwise
+ * the waiter is notified when the lock is handed to it. The waiter must then call
+ * lock_word_wait_granted().
+ *
+ * Must be called inside a critical section. `w` must stay valid until it is granted.
+ */
+void lock_word_requeue(LockWaiter* w) noexcept;
+
+/// Block until ownership of the lock word has been handed to a requeued waiter.
+void lock_word_wait_granted(LockWaiter* w) noexcept;
+
+inline void lock_word_lock(uintptr_t* word) noexcept
+{
+	if(!lock_word_trylock(word))
+	{
+		[[maybe_unused]] auto r = lock_word_lock_slow(word, portMAX_DELAY);
+		assert(r);
+	}
+}
+
+inline void lock_word_unlock(uintptr_t* word) noexcept
+{
+	uintptr_t expected = lock_word_self();
+	if(!__atomic_compare_exchange_n(word, &expected, LOCK_WORD_UNLOCKED, false,
+									__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	{
+		lock_word_unlock_slow(word);
+	}
+}
+} // namespace details
+
+/** Mutex with an atomic fast path.
+ *
+ * An uncontended lock() or unlock() is a single compare-exchange and does not enter a kernel
+ * critical section. Tasks only block, on a task notification, when the mutex is held by
+ * another task. While a task is blocked, the owner runs at the waiter's priority (priority
+ * inheritance). The owner's priority is restored when it releases the mutex.
+ *
+ * This mutex must not be used from an interrupt.
+ *
+ * @note The owner is restored to its original priority when it releases this mutex, even if it
+ *	holds other FastMutex objects that still have waiters.
+ *
+ * @ingroup FreeRTOSOS
+ */
+class FastMutex final : public embvm::VirtualMutex
+{
+  public:
+	/** Construct a fast mutex
+	 *
+	 * @param type The mutex type to create (normal, recursive)
+	 */
+	explicit FastMutex(embvm::mutex::type type = embvm::mutex::type::defaultType) noexcept
+		: type_(type)
+	{
+	}
+
+	/// Default destructor
+	~FastMutex() noexcept
+	{
+		assert(word_ == details::LOCK_WORD_UNLOCKED);
+	}
+
+	void lock() noexcept final
+	{
+		if(type_ == embvm::mutex::type::recursive && owned())
+		{
+			depth_++;
+			return;
+		}
+
+		details::lock_word_lock(&word_);
+	}
+
+	void unlock() noexcept final
+	{
+		assert(owned());
+
+		if(depth_ > 0)
+		{
+			depth_--;
+			return;
+		}
+
+		details::lock_word_unlock(&word_);
+	}
+
+	bool trylock() noexcept final
+	{
+		if(type_ == embvm::mutex::type::recursive && owned())
+		{
+			depth_++;
+			return true;
+		}
+
+		return details::lock_word_trylock(&word_);
+	}
+
+	embvm::mutex::handle_t native_handle() const noexcept final
+	{
+		return reinterpret_cast<embvm::mutex::handle_t>(const_cast<uintptr_t*>(&word_));
+	}
+
+	/** Check whether a VirtualMutex is a FastMutex.
+	 *
+	 * The native handle of a FastMutex is the address of its own lock word, while a kernel
+	 * mutex's handle never points inside the object. This lets code that only has a
+	 * VirtualMutex pointer, such as the factory, tell the two apart without RTTI.
+	 */
+	static bool is(const embvm::VirtualMutex* m) noexcept
+	{
+		auto start = reinterpret_cast<uintptr_t>(m);
+		auto handle = reinterpret_cast<uintptr_t>(m->native_handle());
+		return handle >= start && handle < start + sizeof(FastMutex);
+	}
+
+  private:
+	bool owned() const noexcept
+	{
+		return details::lock_word_owner(&word_) == details::lock_word_self();
+	}
+
+  private:
+	uintptr_t word_ = details::LOCK_WORD_UNLOCKED;
+	embvm::mutex::type type_;
+	/// Recursive lock count beyond the first acquisition
+	uint32_t depth_ = 0;
+};
+
+} // namespace os::freertos
+
+#endif // FREERTOS_FAST_MUTEX_HPP_
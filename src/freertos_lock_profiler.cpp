@@ -0,0 +1,212 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#include "freertos_lock_profiler.hpp"
+#include <FreeRTOS.h>
+#include <cinttypes>
+#include <cstdio>
+#include <task.h>
+
+#if FREERTOS_LOCK_PROFILING
+
+using namespace os::freertos;
+
+namespace
+{
+/// Profiles are only linked and unlinked inside a critical section
+LockProfile* profiles_ = nullptr;
+
+size_t histogram_bucket(uint32_t time) noexcept
+{
+	size_t bucket = 0;
+	while(time > 1 && bucket < LockProfile::HISTOGRAM_BUCKETS - 1)
+	{
+		time >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+void print_histogram(const char* label, const uint32_t* histogram) noexcept
+{
+	printf("  %s:", label);
+	for(size_t i = 0; i < LockProfile::HISTOGRAM_BUCKETS; i++)
+	{
+		printf(" %" PRIu32, histogram[i]);
+	}
+	printf("\n");
+}
+
+const char* kind_name(LockProfile::kind type) noexcept
+{
+	switch(type)
+	{
+		case LockProfile::kind::mutex:
+			return "mutex";
+		case LockProfile::kind::semaphore:
+			return "semaphore";
+		case LockProfile::kind::condition_variable:
+			return "cv";
+	}
+
+	return "?";
+}
+} // namespace
+
+#pragma mark - LockProfile -
+
+void LockProfile::acquired(uint32_t wait_start, bool was_contended) noexcept
+{
+	uint32_t now = FREERTOS_LOCK_PROFILE_TIMESTAMP();
+	uint32_t wait = now - wait_start;
+
+	// Semaphores and condition variables are updated by several tasks at once
+	taskENTER_CRITICAL();
+	acquisitions++;
+	contended += was_contended ? 1 : 0;
+	wait_histogram[histogram_bucket(wait)]++;
+	if(wait > max_wait)
+	{
+		max_wait = wait;
+	}
+
+	owner = xTaskGetCurrentTaskHandle();
+	if(type == kind::mutex && depth++ == 0)
+	{
+		acquired_at = now;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void LockProfile::released() noexcept
+{
+	uint32_t now = FREERTOS_LOCK_PROFILE_TIMESTAMP();
+
+	taskENTER_CRITICAL();
+	if(depth > 0 && --depth == 0)
+	{
+		uint32_t hold = now - acquired_at;
+		hold_histogram[histogram_bucket(hold)]++;
+		if(hold > max_hold)
+		{
+			max_hold = hold;
+		}
+
+		owner = nullptr;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void LockProfile::timed_out(uint32_t wait_start) noexcept
+{
+	uint32_t wait = FREERTOS_LOCK_PROFILE_TIMESTAMP() - wait_start;
+
+	taskENTER_CRITICAL();
+	timeouts++;
+	if(wait > max_wait)
+	{
+		max_wait = wait;
+	}
+	taskEXIT_CRITICAL();
+}
+
+#pragma mark - LockProfiler -
+
+void LockProfiler::add(LockProfile* profile) noexcept
+{
+	taskENTER_CRITICAL();
+	profile->next = profiles_;
+	profiles_ = profile;
+	taskEXIT_CRITICAL();
+}
+
+void LockProfiler::remove(LockProfile* profile) noexcept
+{
+	taskENTER_CRITICAL();
+	for(auto p = &profiles_; *p; p = &(*p)->next)
+	{
+		if(*p == profile)
+		{
+			*p = profile->next;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+}
+
+size_t LockProfiler::snapshot(LockProfile* out, size_t max_count) noexcept
+{
+	size_t count = 0;
+
+	taskENTER_CRITICAL();
+	for(auto p = profiles_; p && count < max_count; p = p->next)
+	{
+		out[count] = *p;
+		out[count].next = nullptr;
+		count++;
+	}
+	taskEXIT_CRITICAL();
+
+	return count;
+}
+
+void LockProfiler::dump() noexcept
+{
+	// Walk the list one entry at a time so printing does not happen inside a critical section
+	for(size_t index = 0;; index++)
+	{
+		LockProfile p;
+		bool found = false;
+
+		taskENTER_CRITICAL();
+		auto it = profiles_;
+		for(size_t i = 0; it && i < index; i++)
+		{
+			it = it->next;
+		}
+
+		if(it)
+		{
+			p = *it;
+			found = true;
+		}
+		taskEXIT_CRITICAL();
+
+		if(!found)
+		{
+			break;
+		}
+
+		printf("%s %s (%p): %" PRIu32 " acquisitions, %" PRIu32 " contended, %" PRIu32
+			   " timeouts, max wait %" PRIu32 ", max hold %" PRIu32 ", owner %p\n",
+			   kind_name(p.type), p.name ? p.name : "", p.object, p.acquisitions, p.contended,
+			   p.timeouts, p.max_wait, p.max_hold, static_cast<void*>(p.owner));
+		print_histogram("wait", p.wait_histogram);
+		if(p.type == LockProfile::kind::mutex)
+		{
+			print_histogram("hold", p.hold_histogram);
+		}
+	}
+}
+
+void LockProfiler::reset() noexcept
+{
+	taskENTER_CRITICAL();
+	for(auto p = profiles_; p; p = p->next)
+	{
+		p->acquisitions = 0;
+		p->contended = 0;
+		p->timeouts = 0;
+		p->max_wait = 0;
+		p->max_hold = 0;
+		for(size_t i = 0; i < LockProfile::HISTOGRAM_BUCKETS; i++)
+		{
+			p->wait_histogram[i] = 0;
+			p->hold_histogram[i] = 0;
+		}
+	}
+	taskEXIT_CRITICAL();
+}
+
+#endif // FREERTOS_LOCK_PROFILING
@@ -0,0 +1,120 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_LOCK_PROFILER_HPP_
+#define FREERTOS_LOCK_PROFILER_HPP_
+
+#include <FreeRTOS.h>
+#include <cstddef>
+#include <cstdint>
+#include <task.h>
+
+/**
+ * Set this macro to 1 to record contention statistics for every Mutex, Semaphore and
+ * ConditionVariable. When it is 0, the primitives carry no profiling state or code.
+ */
+#ifndef FREERTOS_LOCK_PROFILING
+#define FREERTOS_LOCK_PROFILING 0
+#endif
+
+/**
+ * Timestamp used for wait and hold times. The default uses the run time stats counter when
+ * configGENERATE_RUN_TIME_STATS is enabled, and the tick count otherwise.
+ */
+#ifndef FREERTOS_LOCK_PROFILE_TIMESTAMP
+#if configGENERATE_RUN_TIME_STATS == 1
+#define FREERTOS_LOCK_PROFILE_TIMESTAMP() portGET_RUN_TIME_COUNTER_VALUE()
+#else
+#define FREERTOS_LOCK_PROFILE_TIMESTAMP() xTaskGetTickCount()
+#endif
+#endif
+
+#if FREERTOS_LOCK_PROFILING
+namespace os::freertos
+{
+/// @addtogroup FreeRTOSOS
+/// @{
+
+/// Contention counters for one primitive instance.
+struct LockProfile
+{
+	enum class kind : uint8_t
+	{
+		mutex,
+		semaphore,
+		condition_variable,
+	};
+
+	/// Bucket i counts times in [2^i, 2^(i+1)) timestamp units (bucket 0: 0-1)
+	static constexpr size_t HISTOGRAM_BUCKETS = 16;
+
+	/// Optional label shown by LockProfiler::dump(). The string must outlive the primitive.
+	const char* name = nullptr;
+	const void* object = nullptr;
+	kind type = kind::mutex;
+
+	/// Successful takes (condition variables: completed waits)
+	uint32_t acquisitions = 0;
+	/// Acquisitions that had to block
+	uint32_t contended = 0;
+	/// Takes and waits that timed out
+	uint32_t timeouts = 0;
+	uint32_t max_wait = 0;
+	/// Mutexes only
+	uint32_t max_hold = 0;
+	uint32_t wait_histogram[HISTOGRAM_BUCKETS] = {};
+	/// Mutexes only
+	uint32_t hold_histogram[HISTOGRAM_BUCKETS] = {};
+	/// The task that last acquired the primitive. For mutexes, nullptr while unlocked.
+	TaskHandle_t owner = nullptr;
+
+	/// @name Bookkeeping
+	/// Managed by the primitive and LockProfiler.
+	///@{
+	uint32_t acquired_at = 0;
+	uint32_t depth = 0;
+	LockProfile* next = nullptr;
+	///@}
+
+	/// Record a successful take that started waiting at `wait_start`.
+	void acquired(uint32_t wait_start, bool was_contended) noexcept;
+	/// Record a mutex release. Hold time is measured from the outermost acquisition.
+	void released() noexcept;
+	/// Record a take or wait that gave up.
+	void timed_out(uint32_t wait_start) noexcept;
+};
+
+/** Registry of the LockProfile of every live primitive.
+ *
+ * @code
+ * os::freertos::LockProfile profiles[32];
+ * auto count = os::freertos::LockProfiler::snapshot(profiles, 32);
+ * // ...or print everything:
+ * os::freertos::LockProfiler::dump();
+ * @endcode
+ */
+class LockProfiler
+{
+  public:
+	static void add(LockProfile* profile) noexcept;
+	static void remove(LockProfile* profile) noexcept;
+
+	/** Copy the current profiles.
+	 *
+	 * @returns The number of profiles copied, at most `max_count`.
+	 */
+	static size_t snapshot(LockProfile* out, size_t max_count) noexcept;
+
+	/// Print every profile with printf().
+	static void dump() noexcept;
+
+	/// Clear the counters of every profile.
+	static void reset() noexcept;
+};
+
+/// @}
+
+} // namespace os::freertos
+#endif // FREERTOS_LOCK_PROFILING
+
+#endif // FREERTOS_LOCK_PROFILER_HPP_
@@ -3,35 +3,95 @@
 
 #include "freertos_msg_queue.hpp"
 #include <FreeRTOS.h>
+#include <algorithm>
+#include <cstdint>
 #include <queue.h>
+#include <task.h>
 
-#if configSUPPORT_DYNAMIC_ALLOCATION == 0
-#error Static message queues are not supported at this time
+using namespace os::freertos::details;
+
+#pragma mark - Definitions -
+
+/// Maximum number of items copied by push_n() and pop_n() per critical section
+#ifndef OS_MSG_QUEUE_BATCH_CHUNK
+#define OS_MSG_QUEUE_BATCH_CHUNK 8
 #endif
 
-using namespace os::freertos::details;
+#pragma mark - Helpers -
 
-static inline TickType_t convert_timeout(embvm::os_timeout_t timeout) noexcept
+namespace
+{
+/** Move as many items as possible without blocking.
+ *
+ * Items are copied in chunks of OS_MSG_QUEUE_BATCH_CHUNK, each inside one critical section.
+ * The FromISR calls never block or yield, so each item costs a copy rather than a full kernel
+ * call, and interrupts are only masked for one chunk at a time. The scheduler stays suspended
+ * for the whole batch, so a task woken by the first item does not run until the batch is
+ * complete.
+ */
+size_t send_batch(QueueHandle_t queue, const uint8_t* items, size_t item_size,
+				  size_t count) noexcept
 {
-	TickType_t timeout_converted;
+	size_t sent = 0;
+	bool full = false;
 
-	if(timeout == embvm::OS_WAIT_FOREVER)
+	vTaskSuspendAll();
+	while(sent < count && !full)
 	{
-		timeout_converted = portMAX_DELAY;
+		auto chunk_end = sent + std::min<size_t>(count - sent, OS_MSG_QUEUE_BATCH_CHUNK);
+
+		taskENTER_CRITICAL();
+		while(sent < chunk_end &&
+			  xQueueSendToBackFromISR(queue, items + (sent * item_size), nullptr) == pdTRUE)
+		{
+			sent++;
+		}
+		taskEXIT_CRITICAL();
+
+		full = sent < chunk_end;
 	}
-	else
+	(void)xTaskResumeAll();
+
+	return sent;
+}
+
+size_t receive_batch(QueueHandle_t queue, uint8_t* items, size_t item_size, size_t count) noexcept
+{
+	size_t received = 0;
+	bool empty = false;
+
+	vTaskSuspendAll();
+	while(received < count && !empty)
 	{
-		// TODO: real time conversion
-		timeout_converted = std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count();
+		auto chunk_end = received + std::min<size_t>(count - received, OS_MSG_QUEUE_BATCH_CHUNK);
+
+		taskENTER_CRITICAL();
+		while(received < chunk_end &&
+			  xQueueReceiveFromISR(queue, items + (received * item_size), nullptr) == pdTRUE)
+		{
+			received++;
+		}
+		taskEXIT_CRITICAL();
+
+		empty = received < chunk_end;
 	}
+	(void)xTaskResumeAll();
 
-	return timeout_converted;
+	return received;
 }
+} // namespace
 
+#if configSUPPORT_DYNAMIC_ALLOCATION
 embvm::msgqueue::handle_t MessageQueueMediator::create(size_t length, size_t item_size) noexcept
 {
 	return reinterpret_cast<embvm::msgqueue::handle_t>(xQueueCreate(length, item_size));
 }
+#endif
+
+void MessageQueueMediator::destroy(embvm::msgqueue::handle_t handle) noexcept
+{
+	vQueueDelete(reinterpret_cast<QueueHandle_t>(handle));
+}
 
 bool MessageQueueMediator::full(embvm::msgqueue::handle_t handle, size_t max_length) noexcept
 {
@@ -54,15 +114,64 @@ size_t MessageQueueMediator::size(embvm::msgqueue::handle_t handle) noexcept
 }
 
 bool MessageQueueMediator::pop(embvm::msgqueue::handle_t handle, void* buffer,
-							   embvm::os_timeout_t timeout) noexcept
+							   TickType_t timeout) noexcept
 {
-	return pdTRUE ==
-		   xQueueReceive(reinterpret_cast<QueueHandle_t>(handle), buffer, convert_timeout(timeout));
+	return pdTRUE == xQueueReceive(reinterpret_cast<QueueHandle_t>(handle), buffer, timeout);
 }
 
 bool MessageQueueMediator::push(embvm::msgqueue::handle_t handle, const void* buffer,
-								embvm::os_timeout_t timeout) noexcept
+								TickType_t timeout) noexcept
+{
+	return pdTRUE == xQueueSendToBack(reinterpret_cast<QueueHandle_t>(handle), buffer, timeout);
+}
+
+bool MessageQueueMediator::pushFromISR(embvm::msgqueue::handle_t handle, const void* buffer,
+									   BaseType_t* woken) noexcept
+{
+	return pdTRUE ==
+		   xQueueSendToBackFromISR(reinterpret_cast<QueueHandle_t>(handle), buffer, woken);
+}
+
+bool MessageQueueMediator::popFromISR(embvm::msgqueue::handle_t handle, void* buffer,
+									  BaseType_t* woken) noexcept
+{
+	return pdTRUE == xQueueReceiveFromISR(reinterpret_cast<QueueHandle_t>(handle), buffer, woken);
+}
+
+size_t MessageQueueMediator::push_n(embvm::msgqueue::handle_t handle, const void* items,
+									size_t item_size, size_t count, TickType_t timeout) noexcept
+{
+	auto queue = reinterpret_cast<QueueHandle_t>(handle);
+	auto src = static_cast<const uint8_t*>(items);
+
+	auto sent = send_batch(queue, src, item_size, count);
+	if(sent == 0 && count > 0 && timeout != 0)
+	{
+		// The queue is full: block until the first item fits, then send the rest as a batch
+		if(xQueueSendToBack(queue, src, timeout) == pdTRUE)
+		{
+			sent = 1 + send_batch(queue, src + item_size, item_size, count - 1);
+		}
+	}
+
+	return sent;
+}
+
+size_t MessageQueueMediator::pop_n(embvm::msgqueue::handle_t handle, void* items,
+								   size_t item_size, size_t count, TickType_t timeout) noexcept
 {
-	return pdTRUE == xQueueSendToBack(reinterpret_cast<QueueHandle_t>(handle), buffer,
-									  convert_timeout(timeout));
+	auto queue = reinterpret_cast<QueueHandle_t>(handle);
+	auto dst = static_cast<uint8_t*>(items);
+
+	auto received = receive_batch(queue, dst, item_size, count);
+	if(received == 0 && count > 0 && timeout != 0)
+	{
+		// The queue is empty: block until the first item arrives, then take the rest as a batch
+		if(xQueueReceive(queue, dst, timeout) == pdTRUE)
+		{
+			received = 1 + receive_batch(queue, dst + item_size, item_size, count - 1);
+		}
+	}
+
+	return received;
 }
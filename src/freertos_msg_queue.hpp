@@ -4,7 +4,10 @@
 #ifndef FREERTOS_MSG_QUEUE_HPP_
 #define FREERTOS_MSG_QUEUE_HPP_
 
+#include "freertos_os_helpers.hpp"
+#include "freertos_static_primitives.hpp"
 #include <cassert>
+#include <optional>
 #include <rtos/msg_queue.hpp>
 #include <string>
 
@@ -15,15 +18,44 @@ namespace details
 class MessageQueueMediator
 {
   public:
-	static embvm::msgqueue::handle_t create(size_t length, size_t item_size);
-	static void destroy(embvm::msgqueue::handle_t handle);
-	static bool full(embvm::msgqueue::handle_t handle, size_t max_length);
-	static bool empty(embvm::msgqueue::handle_t handle);
-	static void reset(embvm::msgqueue::handle_t handle);
-	static size_t size(embvm::msgqueue::handle_t handle);
-	static bool pop(embvm::msgqueue::handle_t handle, void* buffer, embvm::os_timeout_t timeout);
+	static embvm::msgqueue::handle_t create(size_t length, size_t item_size) noexcept;
+	static void destroy(embvm::msgqueue::handle_t handle) noexcept;
+	static bool full(embvm::msgqueue::handle_t handle, size_t max_length) noexcept;
+	static bool empty(embvm::msgqueue::handle_t handle) noexcept;
+	static void reset(embvm::msgqueue::handle_t handle) noexcept;
+	static size_t size(embvm::msgqueue::handle_t handle) noexcept;
+	static bool pop(embvm::msgqueue::handle_t handle, void* buffer, TickType_t timeout) noexcept;
 	static bool push(embvm::msgqueue::handle_t handle, const void* buffer,
-					 embvm::os_timeout_t timeout);
+					 TickType_t timeout) noexcept;
+	static bool pushFromISR(embvm::msgqueue::handle_t handle, const void* buffer,
+							BaseType_t* woken) noexcept;
+	static bool popFromISR(embvm::msgqueue::handle_t handle, void* buffer,
+						   BaseType_t* woken) noexcept;
+	static size_t push_n(embvm::msgqueue::handle_t handle, const void* items, size_t item_size,
+						 size_t count, TickType_t timeout) noexcept;
+	static size_t pop_n(embvm::msgqueue::handle_t handle, void* items, size_t item_size,
+						size_t count, TickType_t timeout) noexcept;
+};
+
+/// Selects the inline storage used by a MessageQueue with a fixed capacity.
+template<typename TType, size_t TCapacity>
+struct MessageQueueStorage
+{
+#if configSUPPORT_STATIC_ALLOCATION
+	using type = QueueStorage<TType, TCapacity>;
+#else
+	static_assert(TCapacity == 0,
+				  "Fixed-capacity message queues require configSUPPORT_STATIC_ALLOCATION");
+#endif
+};
+
+/// Queues with a runtime length are allocated by the kernel and need no inline storage.
+template<typename TType>
+struct MessageQueueStorage<TType, 0>
+{
+	struct type
+	{
+	};
 };
 } // namespace details
 
@@ -31,50 +63,182 @@ class MessageQueueMediator
 /// @{
 
 /** FreeRTOS Message Queue implementation for OSX
+ *
+ * By default, the queue length is selected at runtime and the queue is allocated from the
+ * FreeRTOS heap. When TCapacity is non-zero, the kernel control block and the item storage are
+ * stored inline in the object and the queue is created with xQueueCreateStatic(), so no heap
+ * memory is used.
+ *
+ * @code
+ * os::freertos::MessageQueue<uint32_t> heap_queue(8);
+ * os::freertos::MessageQueue<uint32_t, 8> static_queue;
+ * @endcode
  *
  * @tparam TType The type of data to be stored in the message queue
+ * @tparam TCapacity The maximum queue length supported by the inline storage, or 0 to allocate
+ *	the queue dynamically.
  */
-template<typename TType>
+template<typename TType, size_t TCapacity = 0>
 class MessageQueue final : public embvm::VirtualMessageQueue<TType>
 {
+	static constexpr bool static_ = TCapacity > 0;
+	/// Number of items drain() moves per context switch
+	static constexpr size_t DRAIN_BATCH_SIZE = 8;
+
   public:
 	/** Construct a message queue
 	 *
-	 * @param queue_length The maximum size of the message queue.
+	 * @param queue_length The maximum size of the message queue. For queues with inline
+	 *	storage, this must not exceed TCapacity. A length of 0, or one larger than TCapacity,
+	 *	leaves the queue with a null native handle.
 	 */
-	explicit MessageQueue(size_t queue_length) noexcept : max_length_(queue_length)
+	explicit MessageQueue(size_t queue_length = TCapacity) noexcept : max_length_(queue_length)
 	{
-		// cppcheck-suppress useInitializationList
-		handle_ = details::MessageQueueMediator::create(queue_length, sizeof(TType));
+		static_assert(static_ || configSUPPORT_DYNAMIC_ALLOCATION,
+					  "Set a non-zero TCapacity when configSUPPORT_DYNAMIC_ALLOCATION is disabled");
+		assert(queue_length > 0);
+
+		if constexpr(static_)
+		{
+			handle_ = reinterpret_cast<embvm::msgqueue::handle_t>(storage_.create(queue_length));
+		}
+		else
+		{
+			handle_ = details::MessageQueueMediator::create(queue_length, sizeof(TType));
+		}
+
 		assert(handle_);
 	}
 
 	/// Default destructor, cleans up the message queue.
 	~MessageQueue() noexcept
 	{
-		details::MessageQueueMediator::destroy(handle_);
+		if(handle_)
+		{
+			details::MessageQueueMediator::destroy(handle_);
+		}
 	}
 
 	bool push(TType val, embvm::os_timeout_t timeout = embvm::OS_WAIT_FOREVER) noexcept final
 	{
-		return details::MessageQueueMediator::push(handle_, &val, timeout);
+		return details::MessageQueueMediator::push(handle_, &val,
+												   frameworkTimeoutToTicks(timeout));
 	}
 
 	std::optional<TType> pop(embvm::os_timeout_t timeout = embvm::OS_WAIT_FOREVER) noexcept final
 	{
 		TType val;
-		auto recvd =
-			details::MessageQueueMediator::pop(handle_, reinterpret_cast<void*>(&val), timeout);
+		auto recvd = details::MessageQueueMediator::pop(handle_, reinterpret_cast<void*>(&val),
+														frameworkTimeoutToTicks(timeout));
 		if(recvd)
 		{
 			return val;
 		}
 		else
 		{
-			return nullptr;
+			return std::nullopt;
 		}
 	}
 
+	/** Push an item from an interrupt without blocking.
+	 *
+	 * Requests a context switch on exit if a higher priority task was waiting for data.
+	 *
+	 * @returns false if the queue is full.
+	 */
+	bool pushFromISR(const TType& val) noexcept
+	{
+		IsrYield yield;
+		return pushFromISR(val, yield);
+	}
+
+	/// Push an item from an interrupt, deferring the context switch to `yield`.
+	bool pushFromISR(const TType& val, IsrYield& yield) noexcept
+	{
+		return details::MessageQueueMediator::pushFromISR(handle_, &val, yield.woken());
+	}
+
+	/** Pop an item from an interrupt without blocking.
+	 *
+	 * Requests a context switch on exit if a higher priority task was waiting for space.
+	 *
+	 * @returns std::nullopt if the queue is empty.
+	 */
+	std::optional<TType> popFromISR() noexcept
+	{
+		IsrYield yield;
+		return popFromISR(yield);
+	}
+
+	/// Pop an item from an interrupt, deferring the context switch to `yield`.
+	std::optional<TType> popFromISR(IsrYield& yield) noexcept
+	{
+		TType val;
+		if(details::MessageQueueMediator::popFromISR(handle_, &val, yield.woken()))
+		{
+			return val;
+		}
+
+		return std::nullopt;
+	}
+
+	/** Push up to `count` items with a single context switch.
+	 *
+	 * If the queue is full, the call blocks until at least one item fits or the timeout
+	 * expires. Tasks woken by the batch do not run until every item that fits has been queued.
+	 *
+	 * @returns The number of items pushed, starting from items[0].
+	 */
+	size_t push_n(const TType* items, size_t count,
+				  embvm::os_timeout_t timeout = embvm::OS_WAIT_FOREVER) noexcept
+	{
+		return details::MessageQueueMediator::push_n(handle_, items, sizeof(TType), count,
+													 frameworkTimeoutToTicks(timeout));
+	}
+
+	/** Pop up to `count` items with a single context switch.
+	 *
+	 * If the queue is empty, the call blocks until at least one item arrives or the timeout
+	 * expires.
+	 *
+	 * @returns The number of items stored in `items`.
+	 */
+	size_t pop_n(TType* items, size_t count,
+				 embvm::os_timeout_t timeout = embvm::OS_WAIT_FOREVER) noexcept
+	{
+		return details::MessageQueueMediator::pop_n(handle_, items, sizeof(TType), count,
+													frameworkTimeoutToTicks(timeout));
+	}
+
+	/** Pop every queued item without blocking.
+	 *
+	 * Items are removed in batches and passed to `f` one at a time. `f` is not called inside
+	 * the batch's critical section.
+	 *
+	 * @returns The number of items handled.
+	 */
+	template<typename TFunctor>
+	size_t drain(TFunctor&& f) noexcept
+	{
+		TType batch[DRAIN_BATCH_SIZE];
+		size_t total = 0;
+		size_t count;
+
+		do
+		{
+			count = details::MessageQueueMediator::pop_n(handle_, batch, sizeof(TType),
+														 DRAIN_BATCH_SIZE, 0);
+			for(size_t i = 0; i < count; i++)
+			{
+				f(batch[i]);
+			}
+
+			total += count;
+		} while(count == DRAIN_BATCH_SIZE);
+
+		return total;
+	}
+
 	size_t size() const noexcept final
 	{
 		return details::MessageQueueMediator::size(handle_);
@@ -100,7 +264,14 @@ class MessageQueue final : public embvm::VirtualMessageQueue<TType>
 		return handle_;
 	}
 
+	/// The largest queue length supported by the inline storage, or 0 for a dynamic queue.
+	static constexpr size_t capacity() noexcept
+	{
+		return TCapacity;
+	}
+
   private:
+	typename details::MessageQueueStorage<TType, TCapacity>::type storage_;
 	embvm::msgqueue::handle_t handle_;
 	size_t max_length_;
 };
@@ -6,14 +6,14 @@
 #include <semphr.h>
 
 #if configSUPPORT_DYNAMIC_ALLOCATION == 0
-#include <etl/pool.h>
+#include "freertos_object_pool.hpp"
 
 #ifndef FREERTOS_MUTEX_POOL_COUNT
 #define FREERTOS_MUTEX_POOL_COUNT 1
 #endif
 
 #if FREERTOS_MUTEX_POOL_COUNT
-etl::pool<StaticSemaphore_t, FREERTOS_MUTEX_POOL_COUNT> static_mutex_pool_;
+os::freertos::LockFreePool<StaticSemaphore_t, FREERTOS_MUTEX_POOL_COUNT> static_mutex_pool_;
 #endif
 #endif
 
@@ -26,7 +26,7 @@ embvm::mutex::handle_t createMutex() noexcept
 #if configSUPPORT_DYNAMIC_ALLOCATION
 	return reinterpret_cast<embvm::mutex::handle_t>(xSemaphoreCreateMutex());
 #elif configSUPPORT_STATIC_ALLOCATION
-	auto buf = static_mutex_pool_.allocate<StaticSemaphore_t>();
+	auto buf = static_mutex_pool_.create();
 	return reinterpret_castembvm::mutex::handle_t > (xSemaphoreCreateMutexStatic(buf))
 #endif
 }
@@ -36,7 +36,7 @@ embvm::mutex::handle_t createRecursiveMutex() noexcept
 #if configSUPPORT_DYNAMIC_ALLOCATION
 	return reinterpret_cast<embvm::mutex::handle_t>(xSemaphoreCreateRecursiveMutex());
 #elif configSUPPORT_STATIC_ALLOCATION
-	auto buf = static_mutex_pool_.allocate<StaticSemaphore_t>();
+	auto buf = static_mutex_pool_.create();
 	return reinterpret_cast<embvm::mutex::handle_t>(xSemaphoreCreateRecursiveMutexStatic(buf));
 #endif
 }
@@ -46,10 +46,14 @@ using namespace os::freertos;
 
 Mutex::~Mutex() noexcept
 {
+#if FREERTOS_LOCK_PROFILING
+	LockProfiler::remove(&profile_);
+#endif
+
 	vSemaphoreDelete(reinterpret_cast<SemaphoreHandle_t>(handle_));
 
 #if configSUPPORT_DYNAMIC_ALLOCATION == 0
-	static_mutex_pool_.release(reinterpret_cast<StaticSemaphore_t*>(handle_));
+	static_mutex_pool_.destroy(reinterpret_cast<StaticSemaphore_t*>(handle_));
 #endif
 }
 
@@ -65,10 +69,26 @@ Mutex::Mutex(embvm::mutex::type type, [[maybe_unused]] embvm::mutex::mode mode)
 			handle_ = createMutex();
 			break;
 	}
+
+#if FREERTOS_LOCK_PROFILING
+	profile_.object = this;
+	profile_.type = LockProfile::kind::mutex;
+	LockProfiler::add(&profile_);
+#endif
 }
 
 void Mutex::lock() noexcept
 {
+#if FREERTOS_LOCK_PROFILING
+	uint32_t wait_start = FREERTOS_LOCK_PROFILE_TIMESTAMP();
+	bool contended = !trylock();
+	if(!contended)
+	{
+		// trylock() recorded the acquisition
+		return;
+	}
+#endif
+
 	if(type_ == embvm::mutex::type::recursive)
 	{
 		auto r =
@@ -80,10 +100,19 @@ void Mutex::lock() noexcept
 		auto r = xSemaphoreTake(reinterpret_cast<SemaphoreHandle_t>(handle_), portMAX_DELAY);
 		assert(r == pdTRUE);
 	}
+
+#if FREERTOS_LOCK_PROFILING
+	profile_.acquired(wait_start, contended);
+#endif
 }
 
 void Mutex::unlock() noexcept
 {
+#if FREERTOS_LOCK_PROFILING
+	// Recorded before the give, while this task still owns the mutex
+	profile_.released();
+#endif
+
 	if(type_ == embvm::mutex::type::recursive)
 	{
 		xSemaphoreGiveRecursive(reinterpret_cast<SemaphoreHandle_t>(handle_));
@@ -107,5 +136,12 @@ bool Mutex::trylock() noexcept
 		r = xSemaphoreTake(reinterpret_cast<SemaphoreHandle_t>(handle_), 0);
 	}
 
+#if FREERTOS_LOCK_PROFILING
+	if(r == pdTRUE)
+	{
+		profile_.acquired(FREERTOS_LOCK_PROFILE_TIMESTAMP(), false);
+	}
+#endif
+
 	return r == pdTRUE;
 }
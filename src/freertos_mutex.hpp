@@ -4,6 +4,7 @@
 #ifndef FREERTOS_MUTEX_HPP_
 #define FREERTOS_MUTEX_HPP_
 
+#include "freertos_lock_profiler.hpp"
 #include <cassert>
 #include <cerrno>
 #include <rtos/mutex.hpp>
@@ -37,10 +38,22 @@ class Mutex final : public embvm::VirtualMutex
 		return handle_;
 	}
 
+#if FREERTOS_LOCK_PROFILING
+	/// Contention statistics for this instance. Set `name` to label it in dumps.
+	LockProfile& profile() noexcept
+	{
+		return profile_;
+	}
+#endif
+
   private:
 	embvm::mutex::handle_t handle_;
 
 	embvm::mutex::type type_;
+
+#if FREERTOS_LOCK_PROFILING
+	LockProfile profile_;
+#endif
 };
 
 } // namespace os::freertos
@@ -0,0 +1,283 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_OBJECT_POOL_HPP_
+#define FREERTOS_OBJECT_POOL_HPP_
+
+#include "freertos_block_pool.hpp"
+#include <FreeRTOS.h>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Set this macro to 0 to stop HybridPool from falling back to the heap when its static slots
+ * are exhausted. Heap overflow is only available when the FreeRTOS heap is.
+ */
+#ifndef OS_POOL_HEAP_OVERFLOW
+#define OS_POOL_HEAP_OVERFLOW configSUPPORT_DYNAMIC_ALLOCATION
+#endif
+
+/**
+ * The allocator used by HybridPool for overflow objects. The default uses the FreeRTOS heap
+ * directly, which works with every heap_N implementation. Applications that use heap.cpp can
+ * route overflow through os::freertos::Heap::alloc() and os::freertos::Heap::free() instead.
+ */
+#ifndef OS_POOL_OVERFLOW_ALLOC
+#define OS_POOL_OVERFLOW_ALLOC(size) pvPortMalloc(size)
+#endif
+
+#ifndef OS_POOL_OVERFLOW_FREE
+#define OS_POOL_OVERFLOW_FREE(ptr) vPortFree(ptr)
+#endif
+
+namespace os::freertos
+{
+/// @addtogroup FreeRTOSOS
+/// @{
+
+/** Lock-free pool of objects.
+ *
+ * A drop-in replacement for etl::pool that is safe to use from any task without a critical
+ * section or scheduler lock. Free slots are tracked with a compare-and-swap free list, so
+ * concurrent create() and destroy() calls never block one another.
+ *
+ * The object constructor and destructor run outside the free list update, so they may block.
+ *
+ * @tparam TType The type of object stored in the pool.
+ * @tparam TCount The number of objects the pool can hold.
+ */
+template<typename TType, size_t TCount>
+class LockFreePool
+{
+  public:
+	LockFreePool() = default;
+
+	/// The pool does not track live objects, so they must all be destroyed first.
+	~LockFreePool() = default;
+
+	LockFreePool(const LockFreePool&) = delete;
+	LockFreePool& operator=(const LockFreePool&) = delete;
+
+	/// Construct an object in the pool. Returns nullptr if the pool is exhausted.
+	template<typename... TArgs>
+	TType* create(TArgs&&... args) noexcept
+	{
+		auto index = free_.pop();
+		if(index == decltype(free_)::INVALID)
+		{
+			return nullptr;
+		}
+
+		return new(&storage_[index * sizeof(TType)]) TType(std::forward<TArgs>(args)...);
+	}
+
+	/// Destroy an object and return its slot to the pool.
+	void destroy(TType* item) noexcept
+	{
+		assert(contains(item));
+		auto offset = static_cast<size_t>(reinterpret_cast<uint8_t*>(item) - storage_);
+		assert((offset % sizeof(TType)) == 0);
+
+		item->~TType();
+		free_.push(offset / sizeof(TType));
+	}
+
+	/// Check whether a pointer refers to an object slot owned by this pool.
+	bool contains(const void* ptr) const noexcept
+	{
+		auto p = static_cast<const uint8_t*>(ptr);
+		return p >= storage_ && p < storage_ + sizeof(storage_);
+	}
+
+	bool full() const noexcept
+	{
+		return free_.empty();
+	}
+
+	static constexpr size_t max_size() noexcept
+	{
+		return TCount;
+	}
+
+  private:
+	details::IndexFreeList<TCount> free_;
+	alignas(TType) uint8_t storage_[sizeof(TType) * TCount];
+};
+
+/// Usage counters for a HybridPool, for sizing the static pools.
+struct PoolStats
+{
+	/// The number of static slots
+	size_t capacity;
+	/// Objects currently allocated, from the static slots or the heap
+	size_t live;
+	/// The largest value `live` has reached
+	size_t peak;
+	/// Number of objects that were allocated from the heap because the static slots were full
+	size_t overflows;
+};
+
+/** Object pool that serves static slots first and overflows to the heap.
+ *
+ * create() takes a slot from a LockFreePool. When every slot is in use, the object is
+ * allocated with OS_POOL_OVERFLOW_ALLOC() instead. With TCount == 0, every object comes from
+ * the heap.
+ *
+ * The pool tracks its live, peak and overflow counts with atomic counters. A pool whose peak
+ * stays below its capacity is over-provisioned. A pool that overflows regularly should be
+ * made larger.
+ *
+ * Overflow objects of types aligned more strictly than portBYTE_ALIGNMENT are placed in an
+ * over-sized heap block, with the address of the block stored just in front of the object.
+ *
+ * @tparam TType The type of object stored in the pool.
+ * @tparam TCount The number of static slots. May be 0.
+ */
+template<typename TType, size_t TCount>
+class HybridPool
+{
+	static constexpr bool CAN_OVERFLOW = OS_POOL_HEAP_OVERFLOW;
+	static constexpr bool OVER_ALIGNED = alignof(TType) > portBYTE_ALIGNMENT;
+
+	static_assert(TCount > 0 || CAN_OVERFLOW, "A pool without static slots requires heap overflow");
+
+	struct NoSlots
+	{
+	};
+
+  public:
+	HybridPool() = default;
+	~HybridPool() = default;
+
+	HybridPool(const HybridPool&) = delete;
+	HybridPool& operator=(const HybridPool&) = delete;
+
+	/// Construct an object. Returns nullptr if no slot is free and the heap is exhausted.
+	template<typename... TArgs>
+	TType* create(TArgs&&... args) noexcept
+	{
+		// Count the object before taking a slot and release the count after returning the
+		// slot, so `live` never under-reports the slots in use
+		auto live = live_.fetch_add(1, std::memory_order_relaxed) + 1;
+		TType* item = nullptr;
+
+		if constexpr(TCount > 0)
+		{
+			item = slots_.create(std::forward<TArgs>(args)...);
+		}
+
+		if constexpr(CAN_OVERFLOW)
+		{
+			if(!item)
+			{
+				if(auto mem = overflow_alloc())
+				{
+					item = new(mem) TType(std::forward<TArgs>(args)...);
+					overflows_.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		if(!item)
+		{
+			live_.fetch_sub(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		auto peak = peak_.load(std::memory_order_relaxed);
+		while(live > peak && !peak_.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+		{
+		}
+
+		return item;
+	}
+
+	void destroy(TType* item) noexcept
+	{
+		assert(item);
+
+		bool in_slot = false;
+		if constexpr(TCount > 0)
+		{
+			in_slot = slots_.contains(item);
+			if(in_slot)
+			{
+				slots_.destroy(item);
+			}
+		}
+
+		if constexpr(CAN_OVERFLOW)
+		{
+			if(!in_slot)
+			{
+				item->~TType();
+				overflow_free(item);
+			}
+		}
+
+		live_.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	PoolStats stats() const noexcept
+	{
+		return {TCount, live_.load(std::memory_order_relaxed),
+				peak_.load(std::memory_order_relaxed), overflows_.load(std::memory_order_relaxed)};
+	}
+
+  private:
+	static void* overflow_alloc() noexcept
+	{
+		if constexpr(OVER_ALIGNED)
+		{
+			auto block =
+				static_cast<uint8_t*>(OS_POOL_OVERFLOW_ALLOC(sizeof(TType) + alignof(TType) +
+															 sizeof(void*)));
+			if(!block)
+			{
+				return nullptr;
+			}
+
+			auto mem = reinterpret_cast<uint8_t*>(
+				(reinterpret_cast<uintptr_t>(block) + sizeof(void*) + alignof(TType) - 1) &
+				~uintptr_t(alignof(TType) - 1));
+			// The slot in front of the object is not necessarily pointer-aligned
+			memcpy(mem - sizeof(void*), &block, sizeof(void*));
+			return mem;
+		}
+		else
+		{
+			return OS_POOL_OVERFLOW_ALLOC(sizeof(TType));
+		}
+	}
+
+	static void overflow_free(void* mem) noexcept
+	{
+		if constexpr(OVER_ALIGNED)
+		{
+			void* block;
+			memcpy(&block, static_cast<uint8_t*>(mem) - sizeof(void*), sizeof(void*));
+			OS_POOL_OVERFLOW_FREE(block);
+		}
+		else
+		{
+			OS_POOL_OVERFLOW_FREE(mem);
+		}
+	}
+
+	std::conditional_t<(TCount > 0), LockFreePool<TType, TCount>, NoSlots> slots_;
+	std::atomic<size_t> live_{0};
+	std::atomic<size_t> peak_{0};
+	std::atomic<size_t> overflows_{0};
+};
+
+/// @}
+
+} // namespace os::freertos
+
+#endif // FREERTOS_OBJECT_POOL_HPP_
@@ -5,24 +5,197 @@
 #define FREERTOS_OS_HELPERS_HPP_
 
 #include "FreeRTOS.h"
+#include <chrono>
+#include <cstdint>
+#include <ratio>
 #include <rtos/rtos_defs.hpp>
+#include <type_traits>
+
+/**
+ * Your application can define this macro to match the cache line size of your processor.
+ *
+ * Static primitives are aligned to this boundary so that the object and the start of its
+ * kernel control block are pulled in with the same cache line. Lock-free structures use it to
+ * keep producer and consumer state on separate lines.
+ */
+#ifndef FREERTOS_CACHE_LINE_SIZE
+#define FREERTOS_CACHE_LINE_SIZE 32
+#endif
 
 namespace os::freertos
 {
-inline uint32_t frameworkTimeoutToTicks(const embvm::os_timeout_t& timeout) noexcept
+/// Event groups use the upper bits of the tick type internally, so only the lower bits are
+/// available for flags.
+#if configUSE_16_BIT_TICKS == 1
+constexpr embvm::eventflag::flag_t EVENT_FLAG_MAX_SUPPORTED_BITS = (1 << 9);
+#else
+constexpr embvm::eventflag::flag_t EVENT_FLAG_MAX_SUPPORTED_BITS = (1 << 24);
+#endif
+
+/** Task notification indices used by the primitives in this library.
+ *
+ * Primitives that block on task notifications use separate indices so they do not consume
+ * each other's wake-ups. When configTASK_NOTIFICATION_ARRAY_ENTRIES is 1, every index maps to
+ * 0; waiters always re-check their wake condition, so sharing a slot only costs spurious
+ * wake-ups.
+ */
+namespace notify_index
 {
-	if(timeout == embvm::OS_WAIT_FOREVER)
+constexpr UBaseType_t slot(UBaseType_t index) noexcept
+{
+	return (index < configTASK_NOTIFICATION_ARRAY_ENTRIES) ? index : 0;
+}
+
+/// Used by ConditionVariable waiters
+constexpr UBaseType_t condition_variable = 0;
+/// Used by tasks blocked on a FastMutex
+constexpr UBaseType_t lock = slot(1);
+/// Used by SpscRing consumers
+constexpr UBaseType_t ring = slot(2);
+/// Used by tasks blocked in Thread::join()
+constexpr UBaseType_t join = slot(3);
+/// Used by parked Executor workers
+constexpr UBaseType_t executor = slot(4);
+/// Used by tasks waiting for another task's std::call_once initializer
+constexpr UBaseType_t once = slot(5);
+} // namespace notify_index
+
+/** Combines the context switch requests of several FromISR calls into a single yield.
+ *
+ * Pass the same object to every FromISR operation in an interrupt handler. The handler yields
+ * at most once, when the object goes out of scope or yield() is called, instead of once per
+ * operation.
+ *
+ * @code
+ * void uart_rx_isr()
+ * {
+ * 	os::freertos::IsrYield yield;
+ * 	rx_queue.pushFromISR(read_byte(), yield);
+ * 	rx_event.setFromISR(RX_READY, yield);
+ * } // Switches to the highest priority woken task here, if any
+ * @endcode
+ */
+class IsrYield
+{
+  public:
+	IsrYield() = default;
+
+	~IsrYield() noexcept
 	{
-		return portMAX_DELAY;
+		yield();
+	}
+
+	IsrYield(const IsrYield&) = delete;
+	IsrYield& operator=(const IsrYield&) = delete;
+
+	/// The "higher priority task woken" argument for FreeRTOS FromISR functions
+	BaseType_t* woken() noexcept
+	{
+		return &woken_;
+	}
+
+	/// Request a context switch now if any operation woke a higher priority task.
+	void yield() noexcept
+	{
+		portYIELD_FROM_ISR(woken_);
+		woken_ = pdFALSE;
 	}
-	else
+
+  private:
+	BaseType_t woken_ = pdFALSE;
+};
+
+/// The duration of a single FreeRTOS tick
+using tick_duration = std::chrono::duration<TickType_t, std::ratio<1, configTICK_RATE_HZ>>;
+
+/// The longest finite delay. portMAX_DELAY itself means "wait forever".
+constexpr TickType_t MAX_FINITE_TICKS = portMAX_DELAY - 1;
+
+/** Convert a duration to FreeRTOS ticks.
+ *
+ * The result is rounded up so that a timeout never expires early. Durations that do not fit
+ * in TickType_t saturate at MAX_FINITE_TICKS, so a long timeout never wraps into a short one
+ * or turns into an infinite wait on 16-bit tick builds.
+ *
+ * This function is constexpr, so timeouts known at compile time fold to constants.
+ */
+template<typename TRep, typename TPeriod>
+constexpr TickType_t durationToTicks(const std::chrono::duration<TRep, TPeriod>& d) noexcept
+{
+	static_assert(std::is_integral<TRep>::value, "Tick conversion requires an integral duration");
+
+	// Ticks per unit of the input duration, expressed as num/den
+	using ratio = std::ratio_divide<TPeriod, std::ratio<1, configTICK_RATE_HZ>>;
+	constexpr uint64_t num = static_cast<uint64_t>(ratio::num);
+	constexpr uint64_t den = static_cast<uint64_t>(ratio::den);
+	constexpr uint64_t max_count = (UINT64_MAX - (den - 1)) / num;
+
+	if(d.count() <= 0)
 	{
-		// TODO: actual conversion to ticks... this is fake millisecond conversion
-		return static_cast<uint32_t>(
-			std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count());
+		return 0;
 	}
+
+	auto count = static_cast<uint64_t>(d.count());
+	if(count > max_count)
+	{
+		return MAX_FINITE_TICKS;
+	}
+
+	auto ticks = (count * num + (den - 1)) / den;
+	return (ticks >= MAX_FINITE_TICKS) ? MAX_FINITE_TICKS : static_cast<TickType_t>(ticks);
+}
+
+/** Convert a sleep duration to the tick count to pass to vTaskDelay().
+ *
+ * vTaskDelay(n) can return up to one tick early, since the current tick period is already
+ * partly over. One tick is added so the task sleeps for at least the requested duration. The
+ * result saturates at MAX_FINITE_TICKS. Durations of zero or less return 0.
+ */
+template<typename TRep, typename TPeriod>
+constexpr TickType_t durationToDelayTicks(const std::chrono::duration<TRep, TPeriod>& d) noexcept
+{
+	auto ticks = durationToTicks(d);
+
+	if(ticks == 0)
+	{
+		return 0;
+	}
+
+	return (ticks < MAX_FINITE_TICKS) ? ticks + 1 : MAX_FINITE_TICKS;
 }
 
+/// Convert FreeRTOS ticks to a framework duration.
+constexpr embvm::os_timeout_t ticksToDuration(TickType_t ticks) noexcept
+{
+	return std::chrono::duration_cast<embvm::os_timeout_t>(tick_duration(ticks));
+}
+
+/** Convert a framework timeout to FreeRTOS ticks.
+ *
+ * embvm::OS_WAIT_FOREVER maps to portMAX_DELAY. All other values are converted with
+ * durationToTicks().
+ */
+constexpr TickType_t frameworkTimeoutToTicks(const embvm::os_timeout_t& timeout) noexcept
+{
+	if(timeout == embvm::OS_WAIT_FOREVER)
+	{
+		return portMAX_DELAY;
+	}
+
+	return durationToTicks(timeout);
+}
+
+static_assert(durationToTicks(std::chrono::seconds(1)) == configTICK_RATE_HZ);
+static_assert(durationToTicks(std::chrono::nanoseconds(1)) == 1, "Timeouts must round up");
+static_assert(durationToTicks(std::chrono::seconds(0)) == 0);
+static_assert(durationToTicks(std::chrono::hours(24 * 365 * 1000)) == MAX_FINITE_TICKS,
+			  "Long timeouts must saturate");
+static_assert(frameworkTimeoutToTicks(embvm::OS_WAIT_FOREVER) == portMAX_DELAY);
+static_assert(durationToDelayTicks(std::chrono::nanoseconds(1)) == 2,
+			  "Sleeps must last at least the requested duration");
+static_assert(durationToDelayTicks(std::chrono::seconds(0)) == 0);
+static_assert(durationToDelayTicks(std::chrono::hours(24 * 365 * 1000)) == MAX_FINITE_TICKS);
+
 } // namespace os::freertos
 
 #endif // FREERTOS_OS_HELPERS_HPP_
@@ -0,0 +1,87 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#include "freertos_periodic_thread.hpp"
+#include "freertos_os_helpers.hpp"
+#include <FreeRTOS.h>
+#include <algorithm>
+#include <cassert>
+#include <task.h>
+
+using namespace os::freertos;
+
+static_assert(INCLUDE_vTaskDelayUntil, "PeriodicSchedule requires INCLUDE_vTaskDelayUntil");
+
+#pragma mark - PeriodicSchedule -
+
+PeriodicSchedule::PeriodicSchedule(const embvm::os_timeout_t& period) noexcept
+	: period_(durationToTicks(period)), last_release_(xTaskGetTickCount())
+{
+	assert(period_ > 0);
+}
+
+void PeriodicSchedule::reset() noexcept
+{
+	last_release_ = xTaskGetTickCount();
+	stats_ = PeriodStats();
+}
+
+bool PeriodicSchedule::wait() noexcept
+{
+	// Unsigned arithmetic keeps these differences correct across tick count overflow
+	TickType_t elapsed = xTaskGetTickCount() - last_release_;
+	bool on_time = elapsed <= period_;
+
+	if(!on_time)
+	{
+		// Skip every release time that has already passed
+		TickType_t missed = (elapsed - 1) / period_;
+		last_release_ += missed * period_;
+		stats_.overruns++;
+		stats_.missed_releases += missed;
+	}
+
+	Thread::delay_until(last_release_, period_);
+
+	TickType_t latency = xTaskGetTickCount() - last_release_;
+	stats_.periods++;
+	stats_.min_latency = std::min(stats_.min_latency, latency);
+	stats_.max_latency = std::max(stats_.max_latency, latency);
+	stats_.total_latency += latency;
+
+	return on_time;
+}
+
+#pragma mark - PeriodicThread -
+
+PeriodicThread::PeriodicThread(std::string_view name, const embvm::os_timeout_t& period,
+							   embvm::thread::func_t func, embvm::thread::input_t arg,
+							   embvm::thread::priority p, size_t stack_size,
+							   void* stack_ptr) noexcept
+	: schedule_(period), func_(func), arg_(arg), thread_(name, run, this, p, stack_size, stack_ptr)
+{
+}
+
+PeriodicThread::~PeriodicThread() noexcept
+{
+	stop();
+}
+
+void PeriodicThread::stop() noexcept
+{
+	stop_ = true;
+	thread_.join();
+}
+
+void PeriodicThread::run(void* periodic_thread) noexcept
+{
+	auto self = reinterpret_cast<PeriodicThread*>(periodic_thread);
+
+	self->schedule_.reset();
+
+	while(!self->stop_)
+	{
+		self->func_(self->arg_);
+		self->schedule_.wait();
+	}
+}
@@ -0,0 +1,159 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_PERIODIC_THREAD_HPP_
+#define FREERTOS_PERIODIC_THREAD_HPP_
+
+#include "freertos_thread.hpp"
+#include <FreeRTOS.h>
+#include <cstdint>
+#include <rtos/rtos_defs.hpp>
+
+namespace os::freertos
+{
+/// @addtogroup FreeRTOSOS
+/// @{
+
+/// Timing statistics for a periodic loop. All times are in ticks.
+struct PeriodStats
+{
+	/// Number of completed periods
+	uint32_t periods = 0;
+	/// Number of periods where the work was still running at the next release time
+	uint32_t overruns = 0;
+	/// Number of release times skipped to get back on schedule after an overrun
+	uint32_t missed_releases = 0;
+	/// Smallest delay between a release time and the task waking up
+	TickType_t min_latency = portMAX_DELAY;
+	/// Largest delay between a release time and the task waking up
+	TickType_t max_latency = 0;
+	/// Sum of all wake-up delays, for computing the average
+	uint64_t total_latency = 0;
+
+	TickType_t average_latency() const noexcept
+	{
+		return periods ? static_cast<TickType_t>(total_latency / periods) : 0;
+	}
+
+	/// The spread of wake-up delays
+	TickType_t jitter() const noexcept
+	{
+		return periods ? max_latency - min_latency : 0;
+	}
+};
+
+/** Drift-free release schedule for a periodic loop.
+ *
+ * Release times are computed from the previous release time with vTaskDelayUntil(), not from
+ * the time the task went to sleep, so a loop does not drift.
+ *
+ * If the work overruns its period, the missed release times are skipped. The loop restarts on
+ * the next release time in the future instead of running several times back-to-back.
+ *
+ * @code
+ * os::freertos::PeriodicSchedule schedule(std::chrono::milliseconds(1));
+ *
+ * while(true)
+ * {
+ * 	run_control_loop();
+ * 	if(!schedule.wait())
+ * 	{
+ * 		log_deadline_miss();
+ * 	}
+ * }
+ * @endcode
+ */
+class PeriodicSchedule
+{
+  public:
+	/** Create a schedule. The first release is one period after construction.
+	 *
+	 * @param period The time between releases. Rounded up to a whole number of ticks.
+	 */
+	explicit PeriodicSchedule(const embvm::os_timeout_t& period) noexcept;
+
+	/** Sleep until the next release time.
+	 *
+	 * @returns false if the work since the previous release overran the period.
+	 */
+	bool wait() noexcept;
+
+	/// Start the schedule from the current time and clear the statistics.
+	void reset() noexcept;
+
+	const PeriodStats& stats() const noexcept
+	{
+		return stats_;
+	}
+
+	TickType_t period() const noexcept
+	{
+		return period_;
+	}
+
+  private:
+	TickType_t period_;
+	/// The most recent release time
+	TickType_t last_release_;
+	PeriodStats stats_;
+};
+
+/** Thread that calls a function once per period.
+ *
+ * The function runs immediately after the thread starts, and then once at every release time
+ * of a PeriodicSchedule.
+ */
+class PeriodicThread
+{
+  public:
+	/** Create and start a periodic thread.
+	 *
+	 * @param name The name of the thread.
+	 * @param period The time between calls to `func`.
+	 * @param func The function to call once per period.
+	 * @param arg The argument passed to `func`.
+	 * @param p The thread priority setting.
+	 * @param stack_size The thread stack size.
+	 * @param stack_ptr The thread stack pointer, or nullptr to allocate the stack.
+	 */
+	PeriodicThread(std::string_view name, const embvm::os_timeout_t& period,
+				   embvm::thread::func_t func, embvm::thread::input_t arg,
+				   embvm::thread::priority p = embvm::thread::priority::normal,
+				   size_t stack_size = FREERTOS_STACK_MIN, void* stack_ptr = nullptr) noexcept;
+
+	/// Stops the thread.
+	~PeriodicThread() noexcept;
+
+	PeriodicThread(const PeriodicThread&) = delete;
+	PeriodicThread& operator=(const PeriodicThread&) = delete;
+
+	/// Stop calling the function and wait for the current call to finish.
+	void stop() noexcept;
+
+	const PeriodStats& stats() const noexcept
+	{
+		return schedule_.stats();
+	}
+
+	Thread& thread() noexcept
+	{
+		return thread_;
+	}
+
+  private:
+	static void run(void* periodic_thread) noexcept;
+
+  private:
+	PeriodicSchedule schedule_;
+	embvm::thread::func_t func_;
+	embvm::thread::input_t arg_;
+	volatile bool stop_ = false;
+	/// Declared last so that the members above are ready before the task starts
+	Thread thread_;
+};
+
+/// @}
+
+} // namespace os::freertos
+
+#endif // FREERTOS_PERIODIC_THREAD_HPP_
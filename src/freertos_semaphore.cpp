@@ -2,19 +2,19 @@
 // SPDX-License-Identifier: MIT
 
 #include "freertos_semaphore.hpp"
+#include "freertos_os_helpers.hpp"
 #include "FreeRTOS.h"
 #include "semphr.h"
-#include <etl/pool.h>
 
 #if configSUPPORT_DYNAMIC_ALLOCATION == 0
-#include <etl/pool.h>
+#include "freertos_object_pool.hpp"
 
 #ifndef FREERTOS_SEMAPHORE_POOL_COUNT
 #define FREERTOS_SEMAPHORE_POOL_COUNT 1
 #endif
 
 #if FREERTOS_SEMAPHORE_POOL_COUNT
-etl::pool<StaticSemaphore_t, FREERTOS_SEMAPHORE_POOL_COUNT> static_sem_pool_;
+os::freertos::LockFreePool<StaticSemaphore_t, FREERTOS_SEMAPHORE_POOL_COUNT> static_sem_pool_;
 #endif
 #endif
 
@@ -27,7 +27,7 @@ embvm::semaphore::handle_t createBinarySemaphore() noexcept
 #if configSUPPORT_DYNAMIC_ALLOCATION
 	return reinterpret_cast<embvm::semaphore::handle_t>(xSemaphoreCreateBinary());
 #elif configSUPPORT_STATIC_ALLOCATION
-	auto buf = static_sem_pool_.allocate<StaticSemaphore_t>();
+	auto buf = static_sem_pool_.create();
 	return reinterpret_cast<embvm::semaphore::handle_t>(xSemaphoreCreateBinaryStatic(buf))
 #endif
 }
@@ -39,7 +39,7 @@ embvm::semaphore::handle_t createCountingSemaphore(embvm::semaphore::count_t cei
 	return reinterpret_cast<embvm::semaphore::handle_t>(
 		xSemaphoreCreateCounting(ceiling, initial_count));
 #elif configSUPPORT_STATIC_ALLOCATION
-	auto buf = static_sem_pool_.allocate<StaticSemaphore_t>();
+	auto buf = static_sem_pool_.create();
 	return reinterpret_cast<embvm::semaphore::handle_t>(
 		xSemaphoreCreateCountingStatic(ceiling, initial_count, buf));
 #endif
@@ -48,16 +48,26 @@ embvm::semaphore::handle_t createCountingSemaphore(embvm::semaphore::count_t cei
 
 Semaphore::~Semaphore() noexcept
 {
+#if FREERTOS_LOCK_PROFILING
+	LockProfiler::remove(&profile_);
+#endif
+
 	vSemaphoreDelete(reinterpret_cast<SemaphoreHandle_t>(handle_));
 
 #if configSUPPORT_DYNAMIC_ALLOCATION == 0
-	static_sem_pool_.release(reinterpret_cast<StaticSemaphore_t*>(handle_));
+	static_sem_pool_.destroy(reinterpret_cast<StaticSemaphore_t*>(handle_));
 #endif
 }
 
 Semaphore::Semaphore(embvm::semaphore::mode mode, embvm::semaphore::count_t ceiling,
 					 embvm::semaphore::count_t initial_count) noexcept
 {
+#if FREERTOS_LOCK_PROFILING
+	profile_.object = this;
+	profile_.type = LockProfile::kind::semaphore;
+	LockProfiler::add(&profile_);
+#endif
+
 	if(initial_count == -1)
 	{
 		initial_count = ceiling;
@@ -93,18 +103,41 @@ void Semaphore::give() noexcept
 
 void Semaphore::giveFromISR() noexcept
 {
-	BaseType_t higher_priority_task_woken;
-	xSemaphoreGiveFromISR(reinterpret_cast<SemaphoreHandle_t>(handle_),
-						  &higher_priority_task_woken);
+	IsrYield yield;
+	giveFromISR(yield);
+}
 
-	portYIELD_FROM_ISR(higher_priority_task_woken);
+void Semaphore::giveFromISR(IsrYield& yield) noexcept
+{
+	xSemaphoreGiveFromISR(reinterpret_cast<SemaphoreHandle_t>(handle_), yield.woken());
 }
 
 bool Semaphore::take(const embvm::os_timeout_t& timeout) noexcept
 {
-	// TODO: convert count properly to ms using
+#if FREERTOS_LOCK_PROFILING
+	uint32_t wait_start = FREERTOS_LOCK_PROFILE_TIMESTAMP();
+	auto ticks = frameworkTimeoutToTicks(timeout);
+
+	// Try without blocking first to tell contended takes apart
+	auto r = xSemaphoreTake(reinterpret_cast<SemaphoreHandle_t>(handle_), 0);
+	bool contended = (r != pdTRUE);
+	if(contended && ticks)
+	{
+		r = xSemaphoreTake(reinterpret_cast<SemaphoreHandle_t>(handle_), ticks);
+	}
+
+	if(r == pdTRUE)
+	{
+		profile_.acquired(wait_start, contended);
+	}
+	else
+	{
+		profile_.timed_out(wait_start);
+	}
+#else
 	auto r = xSemaphoreTake(reinterpret_cast<SemaphoreHandle_t>(handle_),
-							std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count());
+							frameworkTimeoutToTicks(timeout));
+#endif
 
 	return r == pdTRUE;
 }
@@ -4,6 +4,8 @@
 #ifndef FREERTOS_SEMAPHORE_HPP_
 #define FREERTOS_SEMAPHORE_HPP_
 
+#include "freertos_lock_profiler.hpp"
+#include "freertos_os_helpers.hpp"
 #include <cassert>
 #include <rtos/semaphore.hpp>
 #include <string_view>
@@ -35,6 +37,8 @@ class Semaphore final : public embvm::VirtualSemaphore
 
 	void give() noexcept final;
 	void giveFromISR() noexcept final;
+	/// Give the semaphore from an interrupt, deferring the context switch to `yield`.
+	void giveFromISR(IsrYield& yield) noexcept;
 	bool take(const embvm::os_timeout_t& timeout = embvm::OS_WAIT_FOREVER) noexcept final;
 	embvm::semaphore::count_t count() const noexcept final;
 
@@ -43,8 +47,20 @@ class Semaphore final : public embvm::VirtualSemaphore
 		return handle_;
 	}
 
+#if FREERTOS_LOCK_PROFILING
+	/// Contention statistics for this instance. Set `name` to label it in dumps.
+	LockProfile& profile() noexcept
+	{
+		return profile_;
+	}
+#endif
+
   private:
 	embvm::semaphore::handle_t handle_;
+
+#if FREERTOS_LOCK_PROFILING
+	LockProfile profile_;
+#endif
 };
 
 /// @}
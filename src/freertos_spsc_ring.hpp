@@ -0,0 +1,227 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_SPSC_RING_HPP_
+#define FREERTOS_SPSC_RING_HPP_
+
+#include "freertos_os_helpers.hpp"
+#include <FreeRTOS.h>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <task.h>
+
+namespace os::freertos
+{
+/// @addtogroup FreeRTOSOS
+/// @{
+
+/** Lock-free single-producer, single-consumer ring buffer.
+ *
+ * push() and pop() never enter a critical section. The producer may be a task or an interrupt
+ * handler (use pushFromISR()). The consumer must be a task. When the ring is empty, the
+ * consumer blocks on a task notification, and the producer only makes a kernel call when the
+ * consumer is actually waiting.
+ *
+ * Exactly one context may push and exactly one task may pop at any time.
+ *
+ * @code
+ * os::freertos::SpscRing<uint16_t, 256> samples;
+ *
+ * void adc_isr()
+ * {
+ * 	samples.pushFromISR(ADC->DR);
+ * }
+ *
+ * void process_task(void*)
+ * {
+ * 	while(true)
+ * 	{
+ * 		filter(*samples.pop());
+ * 	}
+ * }
+ * @endcode
+ *
+ * @tparam TType The type of data stored in the ring.
+ * @tparam TCapacity The number of items the ring can hold. Must be a power of two.
+ */
+template<typename TType, size_t TCapacity>
+class SpscRing
+{
+	static_assert(TCapacity > 0 && (TCapacity & (TCapacity - 1)) == 0,
+				  "SpscRing capacity must be a power of two");
+	static_assert(std::atomic<TaskHandle_t>::is_always_lock_free,
+				  "SpscRing requires lock-free pointer atomics");
+
+	static constexpr size_t MASK = TCapacity - 1;
+
+  public:
+	SpscRing() = default;
+	~SpscRing() = default;
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	/** Add an item from a task.
+	 *
+	 * Never blocks.
+	 *
+	 * @returns false if the ring is full.
+	 */
+	bool push(const TType& val) noexcept
+	{
+		if(!write(val))
+		{
+			return false;
+		}
+
+		if(auto waiter = take_waiter())
+		{
+			xTaskNotifyGiveIndexed(waiter, notify_index::ring);
+		}
+
+		return true;
+	}
+
+	/// Add an item from an interrupt. Requests a context switch if the consumer was woken.
+	bool pushFromISR(const TType& val) noexcept
+	{
+		IsrYield yield;
+		return pushFromISR(val, yield);
+	}
+
+	/// Add an item from an interrupt, deferring the context switch to `yield`.
+	bool pushFromISR(const TType& val, IsrYield& yield) noexcept
+	{
+		if(!write(val))
+		{
+			return false;
+		}
+
+		if(auto waiter = take_waiter())
+		{
+			vTaskNotifyGiveIndexedFromISR(waiter, notify_index::ring, yield.woken());
+		}
+
+		return true;
+	}
+
+	/// Remove an item without blocking. Returns std::nullopt if the ring is empty.
+	std::optional<TType> try_pop() noexcept
+	{
+		auto head = head_.load(std::memory_order_relaxed);
+		if(head == tail_.load(std::memory_order_acquire))
+		{
+			return std::nullopt;
+		}
+
+		std::optional<TType> val{buffer_[head & MASK]};
+		head_.store(head + 1, std::memory_order_release);
+		return val;
+	}
+
+	/** Remove an item, blocking until one is available or the timeout expires.
+	 *
+	 * Must be called from the consumer task.
+	 *
+	 * @returns std::nullopt if the timeout expired.
+	 */
+	std::optional<TType> pop(embvm::os_timeout_t timeout = embvm::OS_WAIT_FOREVER) noexcept
+	{
+		auto val = try_pop();
+		if(val)
+		{
+			return val;
+		}
+
+		TickType_t ticks = frameworkTimeoutToTicks(timeout);
+		TimeOut_t timeout_state;
+		vTaskSetTimeOutState(&timeout_state);
+
+		while(ticks != 0)
+		{
+			// Publish the wait before re-checking, so a push in between is guaranteed to see it
+			waiter_.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			val = try_pop();
+			if(val)
+			{
+				break;
+			}
+
+			ulTaskNotifyTakeIndexed(notify_index::ring, pdTRUE, ticks);
+
+			val = try_pop();
+			if(val || xTaskCheckForTimeOut(&timeout_state, &ticks) == pdTRUE)
+			{
+				break;
+			}
+		}
+
+		waiter_.store(nullptr, std::memory_order_relaxed);
+		return val;
+	}
+
+	size_t size() const noexcept
+	{
+		return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+	}
+
+	bool empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+	bool full() const noexcept
+	{
+		return size() == TCapacity;
+	}
+
+	static constexpr size_t capacity() noexcept
+	{
+		return TCapacity;
+	}
+
+  private:
+	bool write(const TType& val) noexcept
+	{
+		auto tail = tail_.load(std::memory_order_relaxed);
+		if(tail - head_.load(std::memory_order_acquire) == TCapacity)
+		{
+			return false;
+		}
+
+		buffer_[tail & MASK] = val;
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Claim the blocked consumer, if any, so that only one notification is sent per wait.
+	TaskHandle_t take_waiter() noexcept
+	{
+		// Pairs with the fence in pop(): either we see the waiter, or it sees the new item
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if(!waiter_.load(std::memory_order_relaxed))
+		{
+			return nullptr;
+		}
+
+		return waiter_.exchange(nullptr, std::memory_order_acq_rel);
+	}
+
+  private:
+	/// Written by the consumer
+	alignas(FREERTOS_CACHE_LINE_SIZE) std::atomic<size_t> head_{0};
+	std::atomic<TaskHandle_t> waiter_{nullptr};
+	/// Written by the producer
+	alignas(FREERTOS_CACHE_LINE_SIZE) std::atomic<size_t> tail_{0};
+	alignas(FREERTOS_CACHE_LINE_SIZE) TType buffer_[TCapacity];
+};
+
+/// @}
+
+} // namespace os::freertos
+
+#endif // FREERTOS_SPSC_RING_HPP_
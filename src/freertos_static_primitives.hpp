@@ -0,0 +1,457 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_STATIC_PRIMITIVES_HPP_
+#define FREERTOS_STATIC_PRIMITIVES_HPP_
+
+#include "freertos_os_helpers.hpp"
+#include <FreeRTOS.h>
+#include <cassert>
+#include <cstdint>
+#include <event_groups.h>
+#include <optional>
+#include <queue.h>
+#include <rtos/event_flag.hpp>
+#include <rtos/msg_queue.hpp>
+#include <rtos/mutex.hpp>
+#include <rtos/semaphore.hpp>
+#include <semphr.h>
+#include <type_traits>
+
+#if configSUPPORT_STATIC_ALLOCATION
+
+namespace os::freertos
+{
+namespace details
+{
+/** Inline storage for a FreeRTOS semaphore or mutex.
+ *
+ * FreeRTOS returns the address of the supplied buffer as the handle of a statically
+ * allocated object, so the handle is computed instead of stored.
+ */
+class alignas(FREERTOS_CACHE_LINE_SIZE) SemaphoreStorage
+{
+  public:
+	SemaphoreStorage(const SemaphoreStorage&) = delete;
+	SemaphoreStorage& operator=(const SemaphoreStorage&) = delete;
+
+  protected:
+	SemaphoreStorage() = default;
+	~SemaphoreStorage() noexcept
+	{
+		vSemaphoreDelete(handle());
+	}
+
+	SemaphoreHandle_t handle() const noexcept
+	{
+		return reinterpret_cast<SemaphoreHandle_t>(const_cast<StaticSemaphore_t*>(&buffer_));
+	}
+
+  protected:
+	StaticSemaphore_t buffer_;
+};
+
+/** Inline storage for a FreeRTOS queue and its item buffer.
+ *
+ * @tparam TType The type of data stored in the queue.
+ * @tparam TLength The maximum number of items in the queue.
+ */
+template<typename TType, size_t TLength>
+struct alignas(FREERTOS_CACHE_LINE_SIZE) QueueStorage
+{
+	static_assert(TLength > 0, "Static queues must have a non-zero length");
+	static_assert(std::is_trivially_copyable<TType>::value,
+				  "FreeRTOS queues copy items with memcpy; TType must be trivially copyable");
+
+	/** Create the queue in this storage.
+	 *
+	 * @param length The queue length. May be shorter than TLength.
+	 * @returns The queue handle, or nullptr if length is 0 or larger than TLength.
+	 */
+	QueueHandle_t create(size_t length = TLength) noexcept
+	{
+		// Checked in release builds too: a longer queue would overrun the items buffer
+		if(length == 0 || length > TLength)
+		{
+			return nullptr;
+		}
+
+		auto h = xQueueCreateStatic(static_cast<UBaseType_t>(length), sizeof(TType), items, &queue);
+		assert(h == handle());
+		return h;
+	}
+
+	QueueHandle_t handle() const noexcept
+	{
+		return reinterpret_cast<QueueHandle_t>(const_cast<StaticQueue_t*>(&queue));
+	}
+
+	StaticQueue_t queue;
+	alignas(TType) uint8_t items[TLength * sizeof(TType)];
+};
+} // namespace details
+
+/// @addtogroup FreeRTOSOS
+/// @{
+
+/** Statically dispatched FreeRTOS mutex.
+ *
+ * Unlike os::freertos::Mutex, this type does not derive from embvm::VirtualMutex. The mutex
+ * type is a template parameter, and the kernel control block is stored inline, so lock() and
+ * unlock() compile down to a direct xSemaphoreTake()/xSemaphoreGive() call on the object's
+ * own storage. Use this type when runtime polymorphism is not needed.
+ *
+ * @tparam TType The mutex type to create (normal, recursive)
+ */
+template<embvm::mutex::type TType = embvm::mutex::type::defaultType>
+class StaticMutex final : details::SemaphoreStorage
+{
+	static constexpr bool recursive_ = TType == embvm::mutex::type::recursive;
+
+  public:
+	/// Construct a statically allocated FreeRTOS mutex
+	StaticMutex() noexcept
+	{
+		SemaphoreHandle_t h;
+
+		if constexpr(recursive_)
+		{
+			h = xSemaphoreCreateRecursiveMutexStatic(&buffer_);
+		}
+		else
+		{
+			h = xSemaphoreCreateMutexStatic(&buffer_);
+		}
+
+		assert(h == handle());
+		(void)h;
+	}
+
+	/// Default destructor
+	~StaticMutex() noexcept = default;
+
+	void lock() noexcept
+	{
+		BaseType_t r;
+
+		if constexpr(recursive_)
+		{
+			r = xSemaphoreTakeRecursive(handle(), portMAX_DELAY);
+		}
+		else
+		{
+			r = xSemaphoreTake(handle(), portMAX_DELAY);
+		}
+
+		assert(r == pdTRUE);
+		(void)r;
+	}
+
+	void unlock() noexcept
+	{
+		if constexpr(recursive_)
+		{
+			xSemaphoreGiveRecursive(handle());
+		}
+		else
+		{
+			xSemaphoreGive(handle());
+		}
+	}
+
+	bool trylock() noexcept
+	{
+		BaseType_t r;
+
+		if constexpr(recursive_)
+		{
+			r = xSemaphoreTakeRecursive(handle(), 0);
+		}
+		else
+		{
+			r = xSemaphoreTake(handle(), 0);
+		}
+
+		return r == pdTRUE;
+	}
+
+	embvm::mutex::handle_t native_handle() const noexcept
+	{
+		return reinterpret_cast<embvm::mutex::handle_t>(handle());
+	}
+};
+
+/// Convenience alias for a statically dispatched recursive mutex.
+using StaticRecursiveMutex = StaticMutex<embvm::mutex::type::recursive>;
+
+/** Statically dispatched FreeRTOS semaphore.
+ *
+ * The non-virtual counterpart of os::freertos::Semaphore, with the kernel control block
+ * stored inline.
+ */
+class StaticSemaphore final : details::SemaphoreStorage
+{
+  public:
+	/** Create a statically allocated FreeRTOS semaphore
+	 *
+	 * @param mode The semaphore mode (binary, counting).
+	 * @param ceiling The maximum count of the semaphore
+	 * @param initial_count The starting count of the semaphore. -1 starts the semaphore at the
+	 *	ceiling.
+	 */
+	explicit StaticSemaphore(embvm::semaphore::mode mode = embvm::semaphore::mode::counting,
+							 embvm::semaphore::count_t ceiling = 1,
+							 embvm::semaphore::count_t initial_count = -1) noexcept
+	{
+		if(initial_count == -1)
+		{
+			initial_count = ceiling;
+		}
+
+		SemaphoreHandle_t h;
+
+		if(mode == embvm::semaphore::mode::binary)
+		{
+			h = xSemaphoreCreateBinaryStatic(&buffer_);
+
+			if(initial_count >= 1)
+			{
+				// FreeRTOS binary semaphores start in an empty state and must be given before
+				// they can be taken.
+				give();
+			}
+		}
+		else
+		{
+			h = xSemaphoreCreateCountingStatic(static_cast<UBaseType_t>(ceiling),
+											   static_cast<UBaseType_t>(initial_count), &buffer_);
+		}
+
+		assert(h == handle());
+		(void)h;
+	}
+
+	/// Default destructor
+	~StaticSemaphore() noexcept = default;
+
+	void give() noexcept
+	{
+		xSemaphoreGive(handle());
+	}
+
+	void giveFromISR() noexcept
+	{
+		IsrYield yield;
+		giveFromISR(yield);
+	}
+
+	void giveFromISR(IsrYield& yield) noexcept
+	{
+		xSemaphoreGiveFromISR(handle(), yield.woken());
+	}
+
+	bool take(const embvm::os_timeout_t& timeout = embvm::OS_WAIT_FOREVER) noexcept
+	{
+		return xSemaphoreTake(handle(), frameworkTimeoutToTicks(timeout)) == pdTRUE;
+	}
+
+	embvm::semaphore::count_t count() const noexcept
+	{
+		return static_cast<embvm::semaphore::count_t>(uxSemaphoreGetCount(handle()));
+	}
+
+	embvm::semaphore::handle_t native_handle() const noexcept
+	{
+		return reinterpret_cast<embvm::semaphore::handle_t>(handle());
+	}
+};
+
+/** Statically dispatched FreeRTOS event flag group.
+ *
+ * The non-virtual counterpart of os::freertos::EventFlag, with the kernel control block
+ * stored inline.
+ */
+class alignas(FREERTOS_CACHE_LINE_SIZE) StaticEventFlag final
+{
+  public:
+	/// Create a statically allocated event flag group.
+	StaticEventFlag() noexcept
+	{
+		auto h = xEventGroupCreateStatic(&buffer_);
+		assert(h == handle());
+		(void)h;
+	}
+
+	/// Default destructor which cleans up the event flag group.
+	~StaticEventFlag() noexcept
+	{
+		vEventGroupDelete(handle());
+	}
+
+	StaticEventFlag(const StaticEventFlag&) = delete;
+	StaticEventFlag& operator=(const StaticEventFlag&) = delete;
+
+	embvm::eventflag::flag_t
+		get(embvm::eventflag::flag_t bits_wait,
+			embvm::eventflag::option opt = embvm::eventflag::option::OR, bool clearOnExit = true,
+			const embvm::os_timeout_t& timeout = embvm::OS_WAIT_FOREVER) noexcept
+	{
+		assert(bits_wait < EVENT_FLAG_MAX_SUPPORTED_BITS);
+
+		return static_cast<embvm::eventflag::flag_t>(
+			xEventGroupWaitBits(handle(), bits_wait, clearOnExit,
+								opt == embvm::eventflag::option::AND,
+								frameworkTimeoutToTicks(timeout)));
+	}
+
+	void set(embvm::eventflag::flag_t bits) noexcept
+	{
+		assert(bits < EVENT_FLAG_MAX_SUPPORTED_BITS);
+		xEventGroupSetBits(handle(), bits);
+	}
+
+	void setFromISR(embvm::eventflag::flag_t bits) noexcept
+	{
+		IsrYield yield;
+		setFromISR(bits, yield);
+	}
+
+	void setFromISR(embvm::eventflag::flag_t bits, IsrYield& yield) noexcept
+	{
+		assert(bits < EVENT_FLAG_MAX_SUPPORTED_BITS);
+		xEventGroupSetBitsFromISR(handle(), bits, yield.woken());
+	}
+
+	void clear() noexcept
+	{
+		xEventGroupClearBits(handle(), EVENT_FLAG_MAX_SUPPORTED_BITS - 1);
+	}
+
+	embvm::eventflag::handle_t native_handle() const noexcept
+	{
+		return reinterpret_cast<embvm::eventflag::handle_t>(handle());
+	}
+
+  private:
+	EventGroupHandle_t handle() const noexcept
+	{
+		return reinterpret_cast<EventGroupHandle_t>(const_cast<StaticEventGroup_t*>(&buffer_));
+	}
+
+  private:
+	StaticEventGroup_t buffer_;
+};
+
+/** Statically dispatched FreeRTOS message queue with inline storage.
+ *
+ * @tparam TType The type of data to be stored in the message queue. FreeRTOS copies items
+ *	with memcpy, so the type must be trivially copyable.
+ * @tparam TLength The maximum number of items in the queue.
+ */
+template<typename TType, size_t TLength>
+class StaticMessageQueue final
+{
+  public:
+	/// Construct a statically allocated message queue
+	StaticMessageQueue() noexcept
+	{
+		storage_.create();
+	}
+
+	/// Default destructor, cleans up the message queue.
+	~StaticMessageQueue() noexcept
+	{
+		vQueueDelete(storage_.handle());
+	}
+
+	StaticMessageQueue(const StaticMessageQueue&) = delete;
+	StaticMessageQueue& operator=(const StaticMessageQueue&) = delete;
+
+	bool push(const TType& val, embvm::os_timeout_t timeout = embvm::OS_WAIT_FOREVER) noexcept
+	{
+		return xQueueSendToBack(storage_.handle(), &val, frameworkTimeoutToTicks(timeout)) ==
+			   pdTRUE;
+	}
+
+	std::optional<TType> pop(embvm::os_timeout_t timeout = embvm::OS_WAIT_FOREVER) noexcept
+	{
+		std::optional<TType> val{std::in_place};
+
+		if(xQueueReceive(storage_.handle(), &*val, frameworkTimeoutToTicks(timeout)) != pdTRUE)
+		{
+			val.reset();
+		}
+
+		return val;
+	}
+
+	bool pushFromISR(const TType& val) noexcept
+	{
+		IsrYield yield;
+		return pushFromISR(val, yield);
+	}
+
+	bool pushFromISR(const TType& val, IsrYield& yield) noexcept
+	{
+		return xQueueSendToBackFromISR(storage_.handle(), &val, yield.woken()) == pdTRUE;
+	}
+
+	std::optional<TType> popFromISR() noexcept
+	{
+		IsrYield yield;
+		return popFromISR(yield);
+	}
+
+	std::optional<TType> popFromISR(IsrYield& yield) noexcept
+	{
+		std::optional<TType> val{std::in_place};
+
+		if(xQueueReceiveFromISR(storage_.handle(), &*val, yield.woken()) != pdTRUE)
+		{
+			val.reset();
+		}
+
+		return val;
+	}
+
+	size_t size() const noexcept
+	{
+		return static_cast<size_t>(uxQueueMessagesWaiting(storage_.handle()));
+	}
+
+	void reset() noexcept
+	{
+		xQueueReset(storage_.handle());
+	}
+
+	bool empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+	bool full() const noexcept
+	{
+		return size() == TLength;
+	}
+
+	static constexpr size_t capacity() noexcept
+	{
+		return TLength;
+	}
+
+	embvm::msgqueue::handle_t native_handle() const noexcept
+	{
+		return reinterpret_cast<embvm::msgqueue::handle_t>(storage_.handle());
+	}
+
+  private:
+	details::QueueStorage<TType, TLength> storage_;
+};
+
+/// @}
+
+} // namespace os::freertos
+
+#endif // configSUPPORT_STATIC_ALLOCATION
+
+#endif // FREERTOS_STATIC_PRIMITIVES_HPP_
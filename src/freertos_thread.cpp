@@ -3,34 +3,27 @@
 
 #include "freertos_thread.hpp"
 #include "freertos_os_helpers.hpp"
+#include "freertos_tls.hpp"
 #include <FreeRTOS.h>
 #include <cassert>
 #include <task.h>
 
 #if configSUPPORT_STATIC_ALLOCATION
-#include <etl/pool.h>
+#include "freertos_object_pool.hpp"
 
 #ifndef FREERTOS_THREAD_POOL_COUNT
 #define FREERTOS_THREAD_POOL_COUNT 1
 #endif
 
 #if FREERTOS_THREAD_POOL_COUNT
-etl::pool<StaticTask_t, FREERTOS_THREAD_POOL_COUNT> static_thread_pool_;
+os::freertos::LockFreePool<StaticTask_t, FREERTOS_THREAD_POOL_COUNT> static_thread_pool_;
 #endif
 #endif
 
 using namespace os::freertos;
 
-static volatile thread_exit_t exit_func_ = nullptr;
-
 // TODO: do we want to static assert and assume configUSE_TIME_SLICING?
 
-void os::freertos::register_threadexit_func(thread_exit_t atexit) noexcept
-{
-	assert(exit_func_ == nullptr); // We only support one func at this time, and it's for libcpp
-	exit_func_ = atexit;
-}
-
 #pragma mark - Definitions -
 
 #pragma mark - Helpers -
@@ -72,7 +65,9 @@ static inline UBaseType_t freertos_priority(embvm::thread::priority p) noexcept
 #pragma mark - Thread Class Implementation -
 
 Thread::Thread(std::string_view name, embvm::thread::func_t func, embvm::thread::input_t arg,
-			   embvm::thread::priority p, size_t stack_size, void* stack_ptr) noexcept
+			   embvm::thread::priority p, size_t stack_size, void* stack_ptr,
+			   bool start_suspended) noexcept
+	: func_(func), arg_(arg), started_(!start_suspended)
 {
 	// This variable is read, but the #if confuses cppcheck
 	// cppcheck-suppress unreadVariable
@@ -82,13 +77,20 @@ Thread::Thread(std::string_view name, embvm::thread::func_t func, embvm::thread:
 	// cppcheck-suppress unreadVariable
 	auto adjusted_stack_size = stack_size >> 2;
 
+	// Keep a higher priority thread from running before it can be suspended
+	if(start_suspended)
+	{
+		vTaskSuspendAll();
+	}
+
 	if(stack_ptr)
 	{
 #if configSUPPORT_STATIC_ALLOCATION
 		handle_ =
-			reinterpret_cast<embvm::thread::handle_t>(static_thread_pool_.allocate<StaticTask_t>());
+			reinterpret_cast<embvm::thread::handle_t>(static_thread_pool_.create());
 		auto r = xTaskCreateStatic(
-			func, name.data(), static_cast<uint16_t>(adjusted_stack_size), arg, converted_priority,
+			thread_wrapper, name.data(), static_cast<uint16_t>(adjusted_stack_size), this,
+			converted_priority,
 			reinterpret_cast<StackType_t*>(stack_ptr), reinterpret_cast<StaticTask_t*>(handle_));
 		assert(r);
 		assert(r == handle_); // TODO: is r == handle_? Or do I need to store the thread pool return
@@ -104,8 +106,9 @@ Thread::Thread(std::string_view name, embvm::thread::func_t func, embvm::thread:
 	else
 	{
 #if configSUPPORT_DYNAMIC_ALLOCATION
-		auto r = xTaskCreate(func, name.data(), static_cast<uint16_t>(adjusted_stack_size), arg,
-							 converted_priority, reinterpret_cast<TaskHandle_t*>(&handle_));
+		auto r = xTaskCreate(thread_wrapper, name.data(),
+							 static_cast<uint16_t>(adjusted_stack_size), this, converted_priority,
+							 reinterpret_cast<TaskHandle_t*>(&handle_));
 		assert(r == pdPASS);
 #else
 		// You must provide a stack pointer if dynamic allocation support is not enabled in
@@ -113,6 +116,16 @@ Thread::Thread(std::string_view name, embvm::thread::func_t func, embvm::thread:
 		assert(0);
 #endif
 	}
+
+	if(start_suspended)
+	{
+		if(handle_)
+		{
+			vTaskSuspend(reinterpret_cast<TaskHandle_t>(handle_));
+		}
+
+		(void)xTaskResumeAll();
+	}
 }
 
 Thread::~Thread() noexcept
@@ -122,36 +135,75 @@ Thread::~Thread() noexcept
 
 void Thread::start() noexcept
 {
-	// TODO
+	if(!started_ && handle_)
+	{
+		started_ = true;
+		vTaskResume(reinterpret_cast<TaskHandle_t>(handle_));
+	}
 }
 
-void Thread::terminate() noexcept
+void Thread::startAll(std::initializer_list<Thread*> threads) noexcept
+{
+	startAll(threads.begin(), threads.size());
+}
+
+void Thread::startAll(Thread* const* threads, size_t count) noexcept
 {
-	/// Grab our TLS handle before we destroy the thread
-	auto pdata = pvTaskGetThreadLocalStoragePointer(NULL, 0);
+	vTaskSuspendAll();
+	for(size_t i = 0; i < count; i++)
+	{
+		threads[i]->start();
+	}
+	(void)xTaskResumeAll();
+}
 
+void Thread::terminate() noexcept
+{
 	if(handle_)
 	{
+		// A detached thread releases itself, and its task may still be running
+		assert(!release_);
+
+		/// Grab the thread's TLS table before we destroy it
+		auto tls_table = tls::detach(reinterpret_cast<TaskHandle_t>(handle_));
+
 		vTaskDelete(reinterpret_cast<TaskHandle_t>(handle_));
 
 #if configSUPPORT_STATIC_ALLOCATION
 		if(static_)
 		{
-			static_thread_pool_.release(reinterpret_cast<StaticTask_t*>(handle_));
+			static_thread_pool_.destroy(reinterpret_cast<StaticTask_t*>(handle_));
 		}
 #endif
 
-		// This block is used for libcpp support. If there is TLS data and a registered exit func,
-		// we need to destroy libcpp's data accordingly.
-		if(exit_func_ && pdata)
-		{
-			exit_func_(pdata);
-		}
+		// Run the TLS key destructors (including libcpp's) for the deleted thread
+		tls::destroy(tls_table);
 
 		handle_ = 0;
 	}
 }
 
+void Thread::detach(release_t release) noexcept
+{
+	assert(release);
+	// The task would return its own StaticTask_t slot while still running on it
+	assert(!static_);
+
+	taskENTER_CRITICAL();
+	bool completed = completed_;
+	if(!completed)
+	{
+		release_ = release;
+	}
+	taskEXIT_CRITICAL();
+
+	if(completed)
+	{
+		// The task is parked in thread_wrapper(), so the usual cleanup applies
+		release(this);
+	}
+}
+
 std::string_view Thread::name() const noexcept
 {
 	return pcTaskGetName(reinterpret_cast<TaskHandle_t>(handle_));
@@ -161,7 +213,11 @@ embvm::thread::state Thread::state() const noexcept
 {
 	embvm::thread::state s;
 
-	if(handle_)
+	if(completed_)
+	{
+		s = embvm::thread::state::completed;
+	}
+	else if(handle_)
 	{
 		auto state = eTaskGetState(reinterpret_cast<TaskHandle_t>(handle_));
 		switch(state)
@@ -195,13 +251,81 @@ embvm::thread::state Thread::state() const noexcept
 
 void Thread::join() noexcept
 {
-	if(handle_)
+	[[maybe_unused]] auto r = join(embvm::OS_WAIT_FOREVER);
+	assert(r);
+}
+
+bool Thread::join(const embvm::os_timeout_t& timeout) noexcept
+{
+	if(!handle_)
 	{
-		while(state() != embvm::thread::state::completed &&
-			  state() != embvm::thread::state::terminated)
-		{
-			vTaskDelay(10);
-		}
+		return true;
+	}
+
+	assert(reinterpret_cast<TaskHandle_t>(handle_) != xTaskGetCurrentTaskHandle());
+
+	taskENTER_CRITICAL();
+	if(!completed_)
+	{
+		assert(joiner_ == nullptr); // Only one task may join a thread
+		joiner_ = xTaskGetCurrentTaskHandle();
+	}
+	taskEXIT_CRITICAL();
+
+	auto ticks = frameworkTimeoutToTicks(timeout);
+	TimeOut_t timeout_state;
+	vTaskSetTimeOutState(&timeout_state);
+
+	// thread_wrapper() always notifies us once the thread function returns
+	while(!completed_ && xTaskCheckForTimeOut(&timeout_state, &ticks) == pdFALSE)
+	{
+		ulTaskNotifyTakeIndexed(notify_index::join, pdTRUE, ticks);
+	}
+
+	taskENTER_CRITICAL();
+	joiner_ = nullptr;
+	bool completed = completed_;
+	taskEXIT_CRITICAL();
+
+	return completed;
+}
+
+void Thread::thread_wrapper(void* thread) noexcept
+{
+	auto t = reinterpret_cast<Thread*>(thread);
+
+	t->func_(t->arg_);
+
+	// Run the TLS key destructors on the exiting thread, so terminate() does not need to
+	tls::destroy(tls::table(nullptr));
+
+	taskENTER_CRITICAL();
+	t->completed_ = true;
+	if(t->joiner_)
+	{
+		xTaskNotifyGiveIndexed(t->joiner_, notify_index::join);
+	}
+	auto release = t->release_;
+	if(release)
+	{
+		// This task deletes itself below, so terminate() must leave it alone
+		t->handle_ = 0;
+		t->release_ = nullptr;
+	}
+	taskEXIT_CRITICAL();
+
+	if(release)
+	{
+		// Nobody else owns a detached thread. t is invalid after this call.
+		release(t);
+		vTaskDelete(nullptr);
+	}
+
+	// The Thread object may be destroyed as soon as we leave the critical section. FreeRTOS tasks
+	// must not return, so wait here for the owner to delete the task.
+	while(1)
+	{
+		vTaskSuspend(nullptr);
 	}
 }
 
@@ -210,11 +334,16 @@ void Thread::delay_for(uint32_t ticks) noexcept
 	vTaskDelay(ticks);
 }
 
+void Thread::delay_until(TickType_t& previous_wake, TickType_t period) noexcept
+{
+	vTaskDelayUntil(&previous_wake, period);
+}
+
 #pragma mark - this_thread implementations -
 
 void embvm::this_thread::sleep_for(const embvm::os_timeout_t& delay) noexcept
 {
-	auto ticks = frameworkTimeoutToTicks(delay);
+	auto ticks = (delay == embvm::OS_WAIT_FOREVER) ? portMAX_DELAY : durationToDelayTicks(delay);
 	Thread::delay_for(ticks);
 }
 
@@ -225,5 +354,5 @@ embvm::thread::handle_t embvm::this_thread::get_handle() noexcept
 
 void embvm::this_thread::yield() noexcept
 {
-	Thread::delay_for(1);
+	taskYIELD();
 }
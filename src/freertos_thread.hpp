@@ -4,9 +4,11 @@
 #ifndef FREERTOS_THREAD_HPP_
 #define FREERTOS_THREAD_HPP_
 
+#include <FreeRTOS.h>
+#include <initializer_list>
 #include <rtos/thread.hpp>
+#include <task.h>
 
-// TODO: suspend support... we create threads and suspend them immediately
 // TODO: visit this and see if we are missing any crucial support
 // https://www.codeproject.com/Articles/1278513/Cplusplus11-FreeRTOS-GCC
 
@@ -15,9 +17,6 @@ namespace os::freertos
 /// @addtogroup FreeRTOSOS
 /// @{
 
-using thread_exit_t = void (*)(void*);
-void register_threadexit_func(thread_exit_t atexit) noexcept;
-
 static inline constexpr size_t FREERTOS_STACK_MIN = (1 * 1024);
 
 /** Create a FreeRTOS thread
@@ -47,6 +46,9 @@ static inline constexpr size_t FREERTOS_STACK_MIN = (1 * 1024);
 class Thread final : public embvm::VirtualThread
 {
   public:
+	/// Releases a detached Thread object once its thread function has returned
+	using release_t = void (*)(Thread*);
+
 	Thread() {}
 
 	/** Construct a FreeRTOS thread
@@ -61,21 +63,55 @@ class Thread final : public embvm::VirtualThread
 	 * @param stack_size The thread stack size.
 	 * @param stack_ptr The thread stack pointer. If stack_ptr is nullptr, then memory
 	 * 	will be allocated by the pthread library.
+	 * @param start_suspended If true, the thread does not run until start() or startAll() is
+	 *	called. Otherwise it may run before the constructor returns.
 	 */
 	explicit Thread(std::string_view name, embvm::thread::func_t func, embvm::thread::input_t arg,
 					embvm::thread::priority p = embvm::thread::priority::normal,
-					size_t stack_size = FREERTOS_STACK_MIN, void* stack_ptr = nullptr) noexcept;
+					size_t stack_size = FREERTOS_STACK_MIN, void* stack_ptr = nullptr,
+					bool start_suspended = false) noexcept;
 
 	/// Default destructor, cleans up thread on deletion.
 	~Thread() noexcept;
 
-	// FreeRTOS Threads Auto-start
+	/// Start a thread created with start_suspended. Has no effect on a running thread.
 	void start() noexcept final;
 
+	/** Start a group of suspended threads at the same time.
+	 *
+	 * No thread in the group runs until all of them are ready, so the highest priority thread
+	 * runs first regardless of its position in the list.
+	 */
+	static void startAll(std::initializer_list<Thread*> threads) noexcept;
+	static void startAll(Thread* const* threads, size_t count) noexcept;
+
 	void terminate() noexcept final;
 
 	void join() noexcept final;
 
+	/** Wait for the thread function to return.
+	 *
+	 * The calling task blocks on a task notification sent by the exiting thread, so it wakes
+	 * as soon as the thread function returns.
+	 *
+	 * @note Thread functions must return rather than call vTaskDelete(NULL). A task that
+	 *	deletes itself never sends the notification, so join() would wait for the full timeout.
+	 *
+	 * @param timeout The maximum time to wait.
+	 * @returns true if the thread has finished, false if the timeout expired.
+	 */
+	bool join(const embvm::os_timeout_t& timeout) noexcept;
+
+	/** Let the thread clean up after itself.
+	 *
+	 * When the thread function returns, the exiting task passes its Thread object to `release`
+	 * and then deletes itself. If the function has already returned, `release` is called
+	 * immediately. The caller must not use or destroy the Thread after detaching it.
+	 *
+	 * Threads with a caller-provided stack cannot be detached.
+	 */
+	void detach(release_t release) noexcept;
+
 	std::string_view name() const noexcept final;
 
 	embvm::thread::state state() const noexcept final;
@@ -87,14 +123,34 @@ class Thread final : public embvm::VirtualThread
 
 	static void delay_for(uint32_t ticks) noexcept;
 
+	/** Sleep until a fixed number of ticks after the previous wake time.
+	 *
+	 * Unlike delay_for(), the wake time does not depend on when this function is called, so
+	 * a periodic loop does not drift.
+	 *
+	 * @param previous_wake The tick count of the previous wake time. Updated to the new wake
+	 *	time.
+	 * @param period The number of ticks between wake times.
+	 */
+	static void delay_until(TickType_t& previous_wake, TickType_t period) noexcept;
+
   private:
-	void thread_wrapper(embvm::thread::input_t arg) noexcept;
+	/// Task entry point. Runs the thread function, then signals completion.
+	static void thread_wrapper(void* thread) noexcept;
 
   private:
 	/// The FreeRTOS thread handle
 	embvm::thread::handle_t handle_ = 0;
-	// embvm::thread::func_t func_; // TODO: should this be moved to template param for
-	// compile-time? embvm::thread::input_t arg_; // TODO: how to remove this?
+	embvm::thread::func_t func_ = nullptr;
+	embvm::thread::input_t arg_ = nullptr;
+	/// The task blocked in join(), if any
+	volatile TaskHandle_t joiner_ = nullptr;
+	/// Set when the thread function has returned
+	volatile bool completed_ = false;
+	/// Set by detach(). The exiting task releases the Thread through it.
+	release_t release_ = nullptr;
+	/// False until a thread created with start_suspended is started
+	bool started_ = true;
 	bool static_ = false;
 };
 
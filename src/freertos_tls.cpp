@@ -0,0 +1,152 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#include "freertos_tls.hpp"
+#include "freertos_object_pool.hpp"
+#include <FreeRTOS.h>
+#include <atomic>
+#include <cassert>
+#include <task.h>
+
+using namespace os::freertos;
+
+#pragma mark - Definitions -
+
+/// Destructor passes made over a table, for destructors that set new values (as in POSIX).
+#ifndef FREERTOS_TLS_DESTRUCTOR_ITERATIONS
+#define FREERTOS_TLS_DESTRUCTOR_ITERATIONS 4
+#endif
+
+namespace
+{
+struct TlsTable
+{
+	void* values[FREERTOS_TLS_KEY_COUNT];
+};
+
+std::atomic<size_t> key_count_{0};
+tls_destructor_t destructors_[FREERTOS_TLS_KEY_COUNT];
+HybridPool<TlsTable, FREERTOS_TLS_TABLE_POOL_SIZE> table_pool_;
+
+inline TlsTable* table_for(TaskHandle_t task) noexcept
+{
+	return static_cast<TlsTable*>(pvTaskGetThreadLocalStoragePointer(task, FREERTOS_TLS_SLOT));
+}
+} // namespace
+
+#pragma mark - Key Functions -
+
+bool tls::createKey(tls_key_t* key, tls_destructor_t destructor) noexcept
+{
+	assert(key);
+
+	auto index = key_count_.load(std::memory_order_relaxed);
+	do
+	{
+		if(index == FREERTOS_TLS_KEY_COUNT)
+		{
+			return false;
+		}
+	} while(!key_count_.compare_exchange_weak(index, index + 1, std::memory_order_relaxed));
+
+	// The destructor is published before the key is returned, and therefore before any value
+	// can be stored under it
+	destructors_[index] = destructor;
+	std::atomic_thread_fence(std::memory_order_release);
+
+	*key = index;
+	return true;
+}
+
+void* tls::get(tls_key_t key) noexcept
+{
+	assert(key < FREERTOS_TLS_KEY_COUNT);
+
+	auto table = table_for(nullptr);
+	return table ? table->values[key] : nullptr;
+}
+
+bool tls::set(tls_key_t key, void* value) noexcept
+{
+	assert(key < FREERTOS_TLS_KEY_COUNT);
+
+	auto table = table_for(nullptr);
+	if(!table)
+	{
+		if(!value)
+		{
+			return true;
+		}
+
+		table = table_pool_.create();
+		if(!table)
+		{
+			return false;
+		}
+
+		vTaskSetThreadLocalStoragePointer(nullptr, FREERTOS_TLS_SLOT, table);
+	}
+
+	table->values[key] = value;
+	return true;
+}
+
+#pragma mark - Thread Exit -
+
+void* tls::table(TaskHandle_t task) noexcept
+{
+	return table_for(task);
+}
+
+void* tls::detach(TaskHandle_t task) noexcept
+{
+	auto table = table_for(task);
+	if(table)
+	{
+		vTaskSetThreadLocalStoragePointer(task, FREERTOS_TLS_SLOT, nullptr);
+	}
+
+	return table;
+}
+
+void tls::destroy(void* table) noexcept
+{
+	if(!table)
+	{
+		return;
+	}
+
+	auto t = static_cast<TlsTable*>(table);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	auto count = key_count_.load(std::memory_order_relaxed);
+
+	for(size_t pass = 0; pass < FREERTOS_TLS_DESTRUCTOR_ITERATIONS; pass++)
+	{
+		bool called = false;
+
+		for(size_t key = 0; key < count; key++)
+		{
+			auto value = t->values[key];
+			if(value && destructors_[key])
+			{
+				t->values[key] = nullptr;
+				destructors_[key](value);
+				called = true;
+			}
+		}
+
+		if(!called)
+		{
+			break;
+		}
+	}
+
+	// When a thread cleans up its own table, the table stays attached while the destructors
+	// run, so values they set are destroyed too
+	if(table_for(nullptr) == t)
+	{
+		vTaskSetThreadLocalStoragePointer(nullptr, FREERTOS_TLS_SLOT, nullptr);
+	}
+
+	table_pool_.destroy(t);
+}
@@ -0,0 +1,84 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_TLS_HPP_
+#define FREERTOS_TLS_HPP_
+
+#include <FreeRTOS.h>
+#include <cstddef>
+#include <task.h>
+
+/// The number of thread-local storage keys that can be created.
+#ifndef FREERTOS_TLS_KEY_COUNT
+#define FREERTOS_TLS_KEY_COUNT 8
+#endif
+
+/// The FreeRTOS thread local storage pointer that holds each task's key table.
+#ifndef FREERTOS_TLS_SLOT
+#define FREERTOS_TLS_SLOT 0
+#endif
+
+/// Number of key tables kept in a static pool. Additional tables come from the heap.
+#ifndef FREERTOS_TLS_TABLE_POOL_SIZE
+#define FREERTOS_TLS_TABLE_POOL_SIZE 4
+#endif
+
+static_assert(FREERTOS_TLS_SLOT < configNUM_THREAD_LOCAL_STORAGE_POINTERS,
+			  "FREERTOS_TLS_SLOT must be a valid thread local storage pointer index");
+
+namespace os::freertos
+{
+/// @addtogroup FreeRTOSOS
+/// @{
+
+using tls_key_t = size_t;
+using tls_destructor_t = void (*)(void*);
+
+/** Keyed thread-local storage.
+ *
+ * Each task that stores a value gets a table of FREERTOS_TLS_KEY_COUNT values, reachable
+ * from FreeRTOS thread local storage pointer FREERTOS_TLS_SLOT. Get and set index that table
+ * directly. Keys are never released.
+ *
+ * When a Thread exits or is terminated, the destructor of every key with a non-null value is
+ * called with that value.
+ */
+namespace tls
+{
+/** Allocate a key.
+ *
+ * @param key Receives the new key.
+ * @param destructor Called with the key's value when a thread exits. May be nullptr.
+ * @returns false if every key is in use.
+ */
+bool createKey(tls_key_t* key, tls_destructor_t destructor) noexcept;
+
+/// Get the calling task's value for a key. Returns nullptr if no value has been set.
+void* get(tls_key_t key) noexcept;
+
+/** Set the calling task's value for a key.
+ *
+ * @returns false if the task's key table could not be allocated.
+ */
+bool set(tls_key_t key, void* value) noexcept;
+
+/// Get a task's key table. Pass nullptr for the calling task.
+void* table(TaskHandle_t task) noexcept;
+
+/// Remove a task's key table from the task, so it can be destroyed after the task is deleted.
+void* detach(TaskHandle_t task) noexcept;
+
+/** Run the key destructors on a table and release it.
+ *
+ * A thread that cleans up its own table should pass table(nullptr): the table stays attached
+ * while the destructors run and is detached afterwards. When another task deletes the thread,
+ * detach() the table before vTaskDelete() and destroy it afterwards.
+ */
+void destroy(void* table) noexcept;
+} // namespace tls
+
+/// @}
+
+} // namespace os::freertos
+
+#endif // FREERTOS_TLS_HPP_
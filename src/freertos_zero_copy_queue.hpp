@@ -0,0 +1,204 @@
+// Copyright 2020 Embedded Artistry LLC
+// SPDX-License-Identifier: MIT
+
+#ifndef FREERTOS_ZERO_COPY_QUEUE_HPP_
+#define FREERTOS_ZERO_COPY_QUEUE_HPP_
+
+#include "freertos_block_pool.hpp"
+#include "freertos_msg_queue.hpp"
+#include "freertos_static_primitives.hpp"
+#include <cassert>
+#include <utility>
+
+namespace os::freertos
+{
+/// @addtogroup FreeRTOSOS
+/// @{
+
+/** Message queue that passes ownership of pool-allocated blocks instead of copying data.
+ *
+ * Producers allocate a block, fill it in place, and push it. Only the block pointer travels
+ * through the FreeRTOS queue, so a message is never copied regardless of its size. The
+ * consumer receives a Block handle that returns the memory to the pool when it is destroyed.
+ *
+ * @code
+ * os::freertos::ZeroCopyQueue<1024, 8> frames;
+ *
+ * // Producer
+ * auto block = frames.allocate();
+ * if(block)
+ * {
+ * 	fill_frame(block.data(), block.size());
+ * 	frames.push(std::move(block));
+ * }
+ *
+ * // Consumer
+ * auto frame = frames.pop();
+ * process_frame(frame.data()); // The block is released when `frame` goes out of scope
+ * @endcode
+ *
+ * @tparam TBlockSize The size of each message buffer in bytes.
+ * @tparam TBlockCount The number of message buffers. The queue can hold every buffer, so
+ *	pushing an allocated block never blocks.
+ */
+template<size_t TBlockSize, size_t TBlockCount>
+class ZeroCopyQueue
+{
+	using TPool = BlockPool<TBlockSize, TBlockCount>;
+
+  public:
+	/** Owning handle to a block from a ZeroCopyQueue's pool.
+	 *
+	 * The block is returned to the pool when the handle is destroyed, unless ownership was
+	 * passed on with ZeroCopyQueue::push().
+	 */
+	class Block
+	{
+	  public:
+		Block() = default;
+
+		Block(Block&& other) noexcept
+			: pool_(std::exchange(other.pool_, nullptr)), data_(std::exchange(other.data_, nullptr))
+		{
+		}
+
+		Block& operator=(Block&& other) noexcept
+		{
+			if(this != &other)
+			{
+				reset();
+				pool_ = std::exchange(other.pool_, nullptr);
+				data_ = std::exchange(other.data_, nullptr);
+			}
+
+			return *this;
+		}
+
+		Block(const Block&) = delete;
+		Block& operator=(const Block&) = delete;
+
+		~Block() noexcept
+		{
+			reset();
+		}
+
+		/// Return the block to the pool early.
+		void reset() noexcept
+		{
+			if(data_)
+			{
+				pool_->release(data_);
+				data_ = nullptr;
+			}
+		}
+
+		void* data() const noexcept
+		{
+			return data_;
+		}
+
+		/// Access the block as a specific message type.
+		template<typename TType>
+		TType* as() const noexcept
+		{
+			static_assert(sizeof(TType) <= TBlockSize, "Type does not fit in the block");
+			return static_cast<TType*>(data_);
+		}
+
+		static constexpr size_t size() noexcept
+		{
+			return TBlockSize;
+		}
+
+		explicit operator bool() const noexcept
+		{
+			return data_ != nullptr;
+		}
+
+	  private:
+		friend class ZeroCopyQueue;
+
+		Block(TPool* pool, void* data) noexcept : pool_(pool), data_(data) {}
+
+		void* release() noexcept
+		{
+			return std::exchange(data_, nullptr);
+		}
+
+	  private:
+		TPool* pool_ = nullptr;
+		void* data_ = nullptr;
+	};
+
+  public:
+	ZeroCopyQueue() = default;
+	~ZeroCopyQueue() = default;
+
+	ZeroCopyQueue(const ZeroCopyQueue&) = delete;
+	ZeroCopyQueue& operator=(const ZeroCopyQueue&) = delete;
+
+	/** Take an empty block from the pool.
+	 *
+	 * Does not block. The returned handle is empty if every block is in use.
+	 */
+	Block allocate() noexcept
+	{
+		return Block(&pool_, pool_.allocate());
+	}
+
+	/** Pass ownership of a block to the consumer.
+	 *
+	 * On success, `block` is left empty. On failure, `block` still owns the memory.
+	 */
+	bool push(Block&& block, embvm::os_timeout_t timeout = embvm::OS_WAIT_FOREVER) noexcept
+	{
+		assert(block.pool_ == &pool_);
+
+		bool success = queue_.push(block.data_, timeout);
+		if(success)
+		{
+			block.release();
+		}
+
+		return success;
+	}
+
+	/** Receive the next block.
+	 *
+	 * The returned handle is empty if the timeout expired.
+	 */
+	Block pop(embvm::os_timeout_t timeout = embvm::OS_WAIT_FOREVER) noexcept
+	{
+		auto data = queue_.pop(timeout);
+		return data ? Block(&pool_, *data) : Block();
+	}
+
+	size_t size() const noexcept
+	{
+		return queue_.size();
+	}
+
+	bool empty() const noexcept
+	{
+		return queue_.empty();
+	}
+
+	static constexpr size_t block_size() noexcept
+	{
+		return TBlockSize;
+	}
+
+  private:
+	TPool pool_;
+#if configSUPPORT_STATIC_ALLOCATION
+	StaticMessageQueue<void*, TBlockCount> queue_;
+#else
+	MessageQueue<void*> queue_{TBlockCount};
+#endif
+};
+
+/// @}
+
+} // namespace os::freertos
+
+#endif // FREERTOS_ZERO_COPY_QUEUE_HPP_
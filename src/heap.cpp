@@ -3,6 +3,7 @@
 
 #include "heap.hpp"
 #include <FreeRTOS.h>
+#include <cassert>
 #include <cstdint>
 #include <cstdlib>
 #include <task.h>
@@ -16,10 +17,11 @@
 #pragma mark - Definitions
 
 /**
- * Your application can define this macro to increase the number of heap regions
+ * Your application can define this macro to change how much memory is taken from heap_5 when
+ * a size class runs out of blocks. Slab memory is never returned to heap_5.
  */
-#ifndef FREERTOS_HEAP_REGION_CNT
-#define FREERTOS_HEAP_REGION_CNT 2
+#ifndef FREERTOS_HEAP_SLAB_REFILL_SIZE
+#define FREERTOS_HEAP_SLAB_REFILL_SIZE 1024
 #endif
 
 #pragma mark - Private Functions -
@@ -51,10 +53,367 @@ static volatile uint8_t heap_region_cnt = 0;
  */
 static HeapRegion_t heap_regions[FREERTOS_HEAP_REGION_CNT + 1];
 
+/// A free chunk in a tagged region
+struct ArenaChunk
+{
+	size_t size;
+	ArenaChunk* next;
+};
+
+/// Tagged regions are kept out of heap_5 and managed by a first-fit allocator.
+struct Arena
+{
+	uint8_t* start;
+	size_t size;
+	os::freertos::HeapRegionType type;
+	/// Free chunks in address order
+	ArenaChunk* free_list;
+};
+
+static Arena arenas[FREERTOS_HEAP_REGION_CNT];
+static volatile uint8_t arena_cnt = 0;
+
+#pragma mark - Slab Allocator -
+
+namespace
+{
+/// Stored in front of every allocation so free() can find the block's size class.
+struct alignas(portBYTE_ALIGNMENT) BlockHeader
+{
+	uint32_t size_class;
+	/// The requested size
+	uint32_t size;
+};
+
+/// Size class used for blocks that come straight from heap_5
+constexpr uint32_t LARGE_BLOCK = UINT32_MAX;
+/// Size class used for the header in front of an aligned block. `size` holds the distance back
+/// to the underlying allocation.
+constexpr uint32_t ALIGNED_BLOCK = UINT32_MAX - 1;
+/// Size class base for blocks from a tagged region. The low bits hold the arena index.
+constexpr uint32_t ARENA_BLOCK = 0x80000000;
+
+constexpr size_t SLAB_CLASS_COUNT = os::freertos::heapSlabClassCount();
+
+static_assert((FREERTOS_HEAP_SLAB_MIN_SIZE & (FREERTOS_HEAP_SLAB_MIN_SIZE - 1)) == 0,
+			  "FREERTOS_HEAP_SLAB_MIN_SIZE must be a power of two");
+static_assert(FREERTOS_HEAP_SLAB_MIN_SIZE % portBYTE_ALIGNMENT == 0,
+			  "Slab blocks must preserve the heap alignment");
+static_assert(FREERTOS_HEAP_SLAB_REFILL_SIZE >=
+				  FREERTOS_HEAP_SLAB_MAX_SIZE + sizeof(BlockHeader),
+			  "A refill must hold at least one block of the largest size class");
+
+struct FreeBlock
+{
+	FreeBlock* next;
+};
+
+/// Free lists are only modified inside a critical section
+FreeBlock* free_lists_[SLAB_CLASS_COUNT ? SLAB_CLASS_COUNT : 1];
+
+#if FREERTOS_HEAP_STATS
+size_t slab_reserved_bytes_ = 0;
+#endif
+
+constexpr size_t class_block_size(size_t size_class) noexcept
+{
+	return sizeof(BlockHeader) + (size_t(FREERTOS_HEAP_SLAB_MIN_SIZE) << size_class);
+}
+
+/// Returns the smallest size class that can hold `size`, or SLAB_CLASS_COUNT if none can.
+size_t size_class_for(size_t size) noexcept
+{
+	size_t size_class = 0;
+	for(size_t class_size = FREERTOS_HEAP_SLAB_MIN_SIZE; size_class < SLAB_CLASS_COUNT;
+		class_size <<= 1, size_class++)
+	{
+		if(size <= class_size)
+		{
+			break;
+		}
+	}
+
+	return size_class;
+}
+
+/// Carve a new slab from heap_5 into blocks for a size class.
+bool refill(size_t size_class) noexcept
+{
+	auto block_size = class_block_size(size_class);
+	auto count = FREERTOS_HEAP_SLAB_REFILL_SIZE / block_size;
+	auto slab = static_cast<uint8_t*>(pvPortMalloc(count * block_size));
+
+	if(!slab)
+	{
+		return false;
+	}
+
+	// Link the new blocks together outside the critical section, then splice them in
+	for(size_t i = 0; i < count - 1; i++)
+	{
+		reinterpret_cast<FreeBlock*>(slab + i * block_size)->next =
+			reinterpret_cast<FreeBlock*>(slab + (i + 1) * block_size);
+	}
+
+	auto last = reinterpret_cast<FreeBlock*>(slab + (count - 1) * block_size);
+
+	taskENTER_CRITICAL();
+	last->next = free_lists_[size_class];
+	free_lists_[size_class] = reinterpret_cast<FreeBlock*>(slab);
+#if FREERTOS_HEAP_STATS
+	slab_reserved_bytes_ += count * block_size;
+#endif
+	taskEXIT_CRITICAL();
+
+	return true;
+}
+
+void* slab_alloc(size_t size_class) noexcept
+{
+	FreeBlock* block;
+
+	do
+	{
+		taskENTER_CRITICAL();
+		block = free_lists_[size_class];
+		if(block)
+		{
+			free_lists_[size_class] = block->next;
+		}
+		taskEXIT_CRITICAL();
+	} while(!block && refill(size_class));
+
+	return block;
+}
+
+void slab_free(void* block, size_t size_class) noexcept
+{
+	auto b = static_cast<FreeBlock*>(block);
+
+	taskENTER_CRITICAL();
+	b->next = free_lists_[size_class];
+	free_lists_[size_class] = b;
+	taskEXIT_CRITICAL();
+}
+} // namespace
+
+#pragma mark - Region Arenas -
+
+namespace
+{
+/// Arena chunks are multiples of this size, so a split never leaves a piece too small to track
+constexpr size_t ARENA_GRANULE = (sizeof(ArenaChunk) + portBYTE_ALIGNMENT - 1) &
+								 ~size_t(portBYTE_ALIGNMENT - 1);
+
+constexpr size_t arena_chunk_size(size_t size) noexcept
+{
+	return (sizeof(BlockHeader) + size + ARENA_GRANULE - 1) & ~(ARENA_GRANULE - 1);
+}
+
+void arena_init(Arena& arena) noexcept
+{
+	auto start = reinterpret_cast<uintptr_t>(arena.start);
+	auto aligned = (start + portBYTE_ALIGNMENT - 1) & ~uintptr_t(portBYTE_ALIGNMENT - 1);
+	size_t usable = (arena.size - (aligned - start)) & ~(ARENA_GRANULE - 1);
+
+	arena.free_list = nullptr;
+	if(arena.size > aligned - start && usable >= ARENA_GRANULE)
+	{
+		arena.free_list = reinterpret_cast<ArenaChunk*>(aligned);
+		arena.free_list->size = usable;
+		arena.free_list->next = nullptr;
+	}
+}
+
+/// First-fit allocation. Returns the chunk, or nullptr if the arena has no room.
+void* arena_alloc(Arena& arena, size_t size) noexcept
+{
+	auto needed = arena_chunk_size(size);
+	ArenaChunk* chunk = nullptr;
+
+	vTaskSuspendAll();
+	for(auto prev = &arena.free_list; *prev; prev = &(*prev)->next)
+	{
+		if((*prev)->size >= needed)
+		{
+			chunk = *prev;
+			if(chunk->size > needed)
+			{
+				auto rest = reinterpret_cast<ArenaChunk*>(reinterpret_cast<uint8_t*>(chunk) + needed);
+				rest->size = chunk->size - needed;
+				rest->next = chunk->next;
+				*prev = rest;
+			}
+			else
+			{
+				*prev = chunk->next;
+			}
+			break;
+		}
+	}
+	(void)xTaskResumeAll();
+
+	return chunk;
+}
+
+/// Return a chunk to its arena, merging it with free neighbours.
+void arena_free(Arena& arena, void* block, size_t size) noexcept
+{
+	auto chunk = static_cast<ArenaChunk*>(block);
+	chunk->size = arena_chunk_size(size);
+
+	vTaskSuspendAll();
+	ArenaChunk* prev = nullptr;
+	auto next = arena.free_list;
+	while(next && next < chunk)
+	{
+		prev = next;
+		next = next->next;
+	}
+
+	if(next && reinterpret_cast<uint8_t*>(chunk) + chunk->size == reinterpret_cast<uint8_t*>(next))
+	{
+		chunk->size += next->size;
+		next = next->next;
+	}
+	chunk->next = next;
+
+	if(prev && reinterpret_cast<uint8_t*>(prev) + prev->size == reinterpret_cast<uint8_t*>(chunk))
+	{
+		prev->size += chunk->size;
+		prev->next = chunk->next;
+	}
+	else if(prev)
+	{
+		prev->next = chunk;
+	}
+	else
+	{
+		arena.free_list = chunk;
+	}
+	(void)xTaskResumeAll();
+}
+} // namespace
+
+#pragma mark - Statistics -
+
+#if FREERTOS_HEAP_STATS
+namespace
+{
+/// Counters only. Kernel and region layout fields are filled in by Heap::stats().
+os::freertos::HeapStats stats_;
+
+size_t bucket_for(uint32_t size_class) noexcept
+{
+	return (size_class < SLAB_CLASS_COUNT) ? size_class : SLAB_CLASS_COUNT;
+}
+
+os::freertos::HeapRegionStats* region_for(const void* block) noexcept
+{
+	auto p = static_cast<const uint8_t*>(block);
+
+	for(size_t i = 0; i < heap_region_cnt; i++)
+	{
+		auto start = heap_regions[i].pucStartAddress;
+		if(p >= start && p < start + heap_regions[i].xSizeInBytes)
+		{
+			return &stats_.regions[i];
+		}
+	}
+
+	for(size_t i = 0; i < arena_cnt; i++)
+	{
+		if(p >= arenas[i].start && p < arenas[i].start + arenas[i].size)
+		{
+			return &stats_.regions[heap_region_cnt + i];
+		}
+	}
+
+	return nullptr;
+}
+
+size_t latency_bucket(uint32_t latency) noexcept
+{
+	size_t bucket = 0;
+	while(latency > 1 && bucket < os::freertos::HeapStats::LATENCY_BUCKET_COUNT - 1)
+	{
+		latency >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+void record_alloc(const BlockHeader* header, uint32_t latency) noexcept
+{
+	taskENTER_CRITICAL();
+	auto& b = stats_.buckets[bucket_for(header->size_class)];
+	b.allocations++;
+	b.bytes_in_use += header->size;
+	if(b.bytes_in_use > b.peak_bytes_in_use)
+	{
+		b.peak_bytes_in_use = b.bytes_in_use;
+	}
+
+	if(auto region = region_for(header))
+	{
+		region->bytes_in_use += header->size;
+	}
+
+	stats_.alloc_latency[latency_bucket(latency)]++;
+	taskEXIT_CRITICAL();
+}
+
+void record_failure(size_t size) noexcept
+{
+	auto size_class = size_class_for(size);
+
+	taskENTER_CRITICAL();
+	stats_.buckets[size_class < SLAB_CLASS_COUNT ? size_class : SLAB_CLASS_COUNT].failures++;
+	taskEXIT_CRITICAL();
+}
+
+void record_free(const BlockHeader* header) noexcept
+{
+	taskENTER_CRITICAL();
+	auto& b = stats_.buckets[bucket_for(header->size_class)];
+	b.frees++;
+	b.bytes_in_use -= header->size;
+
+	if(auto region = region_for(header))
+	{
+		region->bytes_in_use -= header->size;
+	}
+	taskEXIT_CRITICAL();
+}
+} // namespace
+#endif
+
 #pragma mark - Class Implementations -
 
-void os::freertos::Heap::addBlock(void* addr, size_t size) noexcept
+void os::freertos::Heap::addBlock(void* addr, size_t size, HeapRegionType type) noexcept
 {
+	if(type != HeapRegionType::general)
+	{
+		assert((arena_cnt < heap_region_max) && "Too many tagged heap regions!");
+
+		uint8_t cnt = arena_cnt++;
+
+		if(cnt < heap_region_max)
+		{
+			arenas[cnt].start = static_cast<uint8_t*>(addr);
+			arenas[cnt].size = size;
+			arenas[cnt].type = type;
+			arena_init(arenas[cnt]);
+		}
+		else
+		{
+			arena_cnt--;
+		}
+
+		return;
+	}
+
 	assert((heap_region_cnt < heap_region_max) && "Too many heap regions!");
 
 	// Increment the count early to claim a spot in case of multi-threads
@@ -75,7 +434,7 @@ void os::freertos::Heap::addBlock(void* addr, size_t size) noexcept
 
 void os::freertos::Heap::init() noexcept
 {
-	assert((heap_region_cnt > 0));
+	assert((heap_region_cnt > 0) && "At least one general heap region is required");
 
 	if(heap_region_cnt > 0)
 	{
@@ -89,17 +448,201 @@ void os::freertos::Heap::init() noexcept
 
 void* os::freertos::Heap::alloc(size_t size) noexcept
 {
-	void* ptr = nullptr;
+	if(size == 0)
+	{
+		return nullptr;
+	}
+
+#if FREERTOS_HEAP_STATS
+	uint32_t start = FREERTOS_HEAP_STATS_TIMESTAMP();
+#endif
 
-	if(size > 0)
+	auto size_class = size_class_for(size);
+	void* block = nullptr;
+
+	if(size_class < SLAB_CLASS_COUNT)
 	{
-		ptr = pvPortMalloc(size);
+		block = slab_alloc(size_class);
 	}
 
-	return ptr;
+	if(!block)
+	{
+		// Large request, or heap_5 could not supply a new slab
+		size_class = LARGE_BLOCK;
+		block = pvPortMalloc(sizeof(BlockHeader) + size);
+	}
+
+	if(!block)
+	{
+#if FREERTOS_HEAP_STATS
+		record_failure(size);
+#endif
+		return nullptr;
+	}
+
+	auto header = static_cast<BlockHeader*>(block);
+	header->size_class = static_cast<uint32_t>(size_class);
+	header->size = static_cast<uint32_t>(size);
+
+#if FREERTOS_HEAP_STATS
+	record_alloc(header, FREERTOS_HEAP_STATS_TIMESTAMP() - start);
+#endif
+
+	return header + 1;
+}
+
+void* os::freertos::Heap::alloc(size_t size, HeapRegionType hint) noexcept
+{
+	if(hint == HeapRegionType::general || size == 0)
+	{
+		return alloc(size);
+	}
+
+#if FREERTOS_HEAP_STATS
+	uint32_t start = FREERTOS_HEAP_STATS_TIMESTAMP();
+#endif
+
+	for(size_t i = 0; i < arena_cnt; i++)
+	{
+		if(arenas[i].type != hint)
+		{
+			continue;
+		}
+
+		if(auto block = arena_alloc(arenas[i], size))
+		{
+			auto header = static_cast<BlockHeader*>(block);
+			header->size_class = ARENA_BLOCK + static_cast<uint32_t>(i);
+			header->size = static_cast<uint32_t>(size);
+
+#if FREERTOS_HEAP_STATS
+			record_alloc(header, FREERTOS_HEAP_STATS_TIMESTAMP() - start);
+#endif
+
+			return header + 1;
+		}
+	}
+
+	return alloc(size);
+}
+
+void* os::freertos::Heap::alloc_aligned(size_t size, size_t alignment,
+										HeapRegionType hint) noexcept
+{
+	assert(alignment && (alignment & (alignment - 1)) == 0);
+
+	if(alignment <= portBYTE_ALIGNMENT)
+	{
+		return alloc(size, hint);
+	}
+
+	// Reserve room for the ALIGNED_BLOCK header in front of the aligned address. The gap between
+	// block and aligned is only a multiple of portBYTE_ALIGNMENT, which can be smaller than
+	// the header.
+	auto block = static_cast<uint8_t*>(alloc(size + alignment + sizeof(BlockHeader), hint));
+	if(!block)
+	{
+		return nullptr;
+	}
+
+	auto aligned = reinterpret_cast<uint8_t*>(
+		(reinterpret_cast<uintptr_t>(block) + sizeof(BlockHeader) + alignment - 1) &
+		~uintptr_t(alignment - 1));
+
+	auto header = reinterpret_cast<BlockHeader*>(aligned) - 1;
+	header->size_class = ALIGNED_BLOCK;
+	header->size = static_cast<uint32_t>(aligned - block);
+
+	return aligned;
 }
 
 void os::freertos::Heap::free(void* addr) noexcept
 {
-	vPortFree(addr);
+	if(!addr)
+	{
+		return;
+	}
+
+	auto header = static_cast<BlockHeader*>(addr) - 1;
+
+	if(header->size_class == ALIGNED_BLOCK)
+	{
+		free(static_cast<uint8_t*>(addr) - header->size);
+		return;
+	}
+
+#if FREERTOS_HEAP_STATS
+	record_free(header);
+#endif
+
+	if(header->size_class == LARGE_BLOCK)
+	{
+		vPortFree(header);
+	}
+	else if(header->size_class >= ARENA_BLOCK)
+	{
+		assert(header->size_class - ARENA_BLOCK < arena_cnt);
+		arena_free(arenas[header->size_class - ARENA_BLOCK], header, header->size);
+	}
+	else
+	{
+		assert(header->size_class < SLAB_CLASS_COUNT);
+		slab_free(header, header->size_class);
+	}
+}
+
+#if FREERTOS_HEAP_STATS
+os::freertos::HeapStats os::freertos::Heap::stats() noexcept
+{
+	taskENTER_CRITICAL();
+	HeapStats s = stats_;
+	s.slab_reserved_bytes = slab_reserved_bytes_;
+	taskEXIT_CRITICAL();
+
+	HeapStats_t kernel;
+	vPortGetHeapStats(&kernel);
+	s.free_bytes = kernel.xAvailableHeapSpaceInBytes;
+	s.minimum_ever_free_bytes = kernel.xMinimumEverFreeBytesRemaining;
+	s.largest_free_block = kernel.xSizeOfLargestFreeBlockInBytes;
+	s.smallest_free_block = kernel.xSizeOfSmallestFreeBlockInBytes;
+	s.free_blocks = kernel.xNumberOfFreeBlocks;
+	s.kernel_allocations = kernel.xNumberOfSuccessfulAllocations;
+	s.kernel_frees = kernel.xNumberOfSuccessfulFrees;
+
+	s.region_count = heap_region_cnt + arena_cnt;
+	for(size_t i = 0; i < heap_region_cnt; i++)
+	{
+		s.regions[i].start = heap_regions[i].pucStartAddress;
+		s.regions[i].size = heap_regions[i].xSizeInBytes;
+		s.regions[i].type = HeapRegionType::general;
+	}
+
+	for(size_t i = 0; i < arena_cnt; i++)
+	{
+		auto& r = s.regions[heap_region_cnt + i];
+		r.start = arenas[i].start;
+		r.size = arenas[i].size;
+		r.type = arenas[i].type;
+	}
+
+	return s;
+}
+
+void os::freertos::Heap::resetStats() noexcept
+{
+	taskENTER_CRITICAL();
+	for(auto& b : stats_.buckets)
+	{
+		b.allocations = 0;
+		b.frees = 0;
+		b.failures = 0;
+		b.peak_bytes_in_use = b.bytes_in_use;
+	}
+
+	for(auto& l : stats_.alloc_latency)
+	{
+		l = 0;
+	}
+	taskEXIT_CRITICAL();
 }
+#endif
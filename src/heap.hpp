@@ -4,8 +4,53 @@
 #ifndef FREERTOS_HEAP_HPP_
 #define FREERTOS_HEAP_HPP_
 
+#include <FreeRTOS.h>
+#include <cstddef>
+#include <cstdint>
 #include <rtos/heap.hpp>
 
+/**
+ * Your application can define this macro to increase the number of heap regions. The limit
+ * applies separately to general regions and to tagged regions.
+ */
+#ifndef FREERTOS_HEAP_REGION_CNT
+#define FREERTOS_HEAP_REGION_CNT 2
+#endif
+
+/**
+ * Your application can define this macro to change the largest request served by the slab
+ * allocator. Size classes are powers of two from FREERTOS_HEAP_SLAB_MIN_SIZE up to this value.
+ * Set it to 0 to send every request to heap_5.
+ */
+#ifndef FREERTOS_HEAP_SLAB_MAX_SIZE
+#define FREERTOS_HEAP_SLAB_MAX_SIZE 256
+#endif
+
+#ifndef FREERTOS_HEAP_SLAB_MIN_SIZE
+#define FREERTOS_HEAP_SLAB_MIN_SIZE 16
+#endif
+
+/**
+ * Set this macro to 1 to collect heap statistics. When it is 0, the statistics API is not
+ * compiled and alloc()/free() do no extra work.
+ */
+#ifndef FREERTOS_HEAP_STATS
+#define FREERTOS_HEAP_STATS 0
+#endif
+
+/**
+ * Timestamp used for the allocation latency histogram. The default uses the run time stats
+ * counter when configGENERATE_RUN_TIME_STATS is enabled. Otherwise every allocation is
+ * recorded in the first histogram bucket.
+ */
+#ifndef FREERTOS_HEAP_STATS_TIMESTAMP
+#if configGENERATE_RUN_TIME_STATS == 1
+#define FREERTOS_HEAP_STATS_TIMESTAMP() portGET_RUN_TIME_COUNTER_VALUE()
+#else
+#define FREERTOS_HEAP_STATS_TIMESTAMP() 0u
+#endif
+#endif
+
 namespace os
 {
 namespace freertos
@@ -13,13 +58,137 @@ namespace freertos
 /// @addtogroup FreeRTOSOS
 /// @{
 
+/// The number of slab size classes
+constexpr size_t heapSlabClassCount() noexcept
+{
+	size_t count = 0;
+	for(size_t size = FREERTOS_HEAP_SLAB_MIN_SIZE; size <= FREERTOS_HEAP_SLAB_MAX_SIZE; size <<= 1)
+	{
+		count++;
+	}
+
+	return count;
+}
+
+/// Kinds of memory a heap region can provide
+enum class HeapRegionType : uint8_t
+{
+	/// Managed by heap_5 and used by every allocation
+	general = 0,
+	/// Fast memory, such as tightly-coupled or on-chip SRAM
+	fast,
+	/// Large, slower memory, such as external RAM
+	bulk,
+};
+
+#if FREERTOS_HEAP_STATS
+/// Allocation counters for one size bucket
+struct HeapBucketStats
+{
+	size_t allocations;
+	size_t frees;
+	/// Requests that could not be satisfied
+	size_t failures;
+	/// Bytes requested by live allocations
+	size_t bytes_in_use;
+	size_t peak_bytes_in_use;
+};
+
+/// Usage of one heap region
+struct HeapRegionStats
+{
+	const void* start;
+	size_t size;
+	HeapRegionType type;
+	/// Bytes requested by live allocations placed in this region
+	size_t bytes_in_use;
+};
+
+/// Snapshot of the heap state returned by Heap::stats()
+struct HeapStats
+{
+	/// One bucket per slab size class, followed by a bucket for larger requests
+	static constexpr size_t BUCKET_COUNT = heapSlabClassCount() + 1;
+	/// Bucket i counts allocations that took [2^i, 2^(i+1)) timestamp units (bucket 0: 0-1)
+	static constexpr size_t LATENCY_BUCKET_COUNT = 16;
+
+	/// @name Reported by heap_5 (vPortGetHeapStats)
+	///@{
+	size_t free_bytes;
+	size_t minimum_ever_free_bytes;
+	size_t largest_free_block;
+	size_t smallest_free_block;
+	size_t free_blocks;
+	size_t kernel_allocations;
+	size_t kernel_frees;
+	///@}
+
+	/// Memory taken from heap_5 for slabs, whether or not it is currently allocated
+	size_t slab_reserved_bytes;
+	HeapBucketStats buckets[BUCKET_COUNT];
+	/// General regions first, in address order, followed by tagged regions
+	HeapRegionStats regions[2 * FREERTOS_HEAP_REGION_CNT];
+	size_t region_count;
+	uint32_t alloc_latency[LATENCY_BUCKET_COUNT];
+};
+#endif
+
+/** FreeRTOS heap_5 wrapper.
+ *
+ * Small requests are served from per-size-class free lists (slabs) in O(1) time, inside a
+ * short critical section. Slabs are carved out of the heap_5 regions on demand. Requests larger
+ * than FREERTOS_HEAP_SLAB_MAX_SIZE go straight to pvPortMalloc().
+ *
+ * Regions can be tagged as fast or bulk memory. Tagged regions are kept out of heap_5 and are
+ * only used by allocations that ask for them, so buffers that need fast memory can be placed
+ * there explicitly:
+ *
+ * @code
+ * Heap::addBlock(&_sram_heap_start, SRAM_HEAP_SIZE);
+ * Heap::addBlock(&_dtcm_heap_start, DTCM_HEAP_SIZE, HeapRegionType::fast);
+ * Heap::init();
+ *
+ * auto taps = Heap::alloc_aligned(1024, 32, HeapRegionType::fast);
+ * @endcode
+ */
 class Heap
 {
   public:
-	static void addBlock(void* addr, size_t size) noexcept;
+	/** Add a region of memory to the heap. Call before init().
+	 *
+	 * @param addr The start of the region.
+	 * @param size The size of the region in bytes.
+	 * @param type The kind of memory. General regions are handed to heap_5. Other regions are
+	 *	only used by allocations with a matching hint.
+	 */
+	static void addBlock(void* addr, size_t size,
+						 HeapRegionType type = HeapRegionType::general) noexcept;
 	static void init() noexcept;
 	static void* alloc(size_t size) noexcept;
 	static void free(void* addr) noexcept;
+
+	/** Allocate memory, preferring a kind of region.
+	 *
+	 * The block is placed in a region of type `hint` if one has room. Otherwise it falls back
+	 * to the general heap, so a full fast region degrades performance but does not fail the
+	 * allocation.
+	 */
+	static void* alloc(size_t size, HeapRegionType hint) noexcept;
+
+	/** Allocate memory aligned to `alignment` bytes, preferring a kind of region.
+	 *
+	 * @param alignment A power of two.
+	 */
+	static void* alloc_aligned(size_t size, size_t alignment,
+							   HeapRegionType hint = HeapRegionType::general) noexcept;
+
+#if FREERTOS_HEAP_STATS
+	/// Take a snapshot of the heap statistics.
+	static HeapStats stats() noexcept;
+
+	/// Clear the counters and histogram. Peak usage restarts from the current usage.
+	static void resetStats() noexcept;
+#endif
 };
 
 /// @}
@@ -29,4 +198,4 @@ using Heap = embvm::VirtualHeap<os::freertos::Heap>;
 
 } // namespace os
 
-#endif FREERTOS_HEAP_HPP_
+#endif // FREERTOS_HEAP_HPP_
@@ -3,6 +3,9 @@
 
 #include <FreeRTOS.h>
 #include <__external_threading>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <errno.h>
 #include <os.hpp>
 #include <task.h>
@@ -25,24 +28,73 @@ int std::__libcpp_recursive_mutex_destroy(std::__libcpp_recursive_mutex_t* __m)
 	return 0;
 }
 
+int std::__libcpp_recursive_mutex_lock(std::__libcpp_recursive_mutex_t* __m)
+{
+	(*__m)->lock();
+	return 0;
+}
+
+bool std::__libcpp_recursive_mutex_trylock(std::__libcpp_recursive_mutex_t* __m)
+{
+	return (*__m)->trylock();
+}
+
+int std::__libcpp_recursive_mutex_unlock(std::__libcpp_recursive_mutex_t* __m)
+{
+	(*__m)->unlock();
+	return 0;
+}
+
 #pragma mark - Mutex Functions -
 
+/*
+ * std::mutex has a constexpr constructor, so its storage is zero-initialized and
+ * __libcpp_mutex_init() is never called for it. The storage is used directly as a FastMutex
+ * lock word: zero is the unlocked state, so a std::mutex is ready to use as soon as static
+ * initialization is done. Locking and unlocking are a compare-and-swap on that word. No mutex
+ * object is created, so std::mutex does not consume factory pool entries.
+ */
+
+static_assert(sizeof(std::__libcpp_mutex_t) >= sizeof(uintptr_t) &&
+				  alignof(std::__libcpp_mutex_t) >= alignof(uintptr_t),
+			  "std::mutex storage must be able to hold a lock word");
+
+namespace
+{
+inline uintptr_t* lock_word(std::__libcpp_mutex_t* m) noexcept
+{
+	return reinterpret_cast<uintptr_t*>(m);
+}
+} // namespace
+
 int std::__libcpp_mutex_init(std::__libcpp_recursive_mutex_t* __m)
 {
-	*__m = os::Factory::createMutex();
+	*lock_word(__m) = os::freertos::details::LOCK_WORD_UNLOCKED;
 	return 0;
 }
 
 int std::__libcpp_mutex_destroy(std::__libcpp_mutex_t* __m)
 {
-	// There is the possibility that we are destroying our mutex without creating it,
-	// since we have to call lock, unlock, or try_lock to actually initialize a std::mutex.
-	// This is because the std::mutex constructor is constexpr... We don't know why.
-	if(*__m)
-	{
-		os::Factory::destroy(*__m);
-	}
+	assert(*lock_word(__m) == os::freertos::details::LOCK_WORD_UNLOCKED &&
+		   "Destroying a locked std::mutex");
+	(void)__m;
+	return 0;
+}
 
+int std::__libcpp_mutex_lock(std::__libcpp_mutex_t* __m)
+{
+	os::freertos::details::lock_word_lock(lock_word(__m));
+	return 0;
+}
+
+bool std::__libcpp_mutex_trylock(std::__libcpp_mutex_t* __m)
+{
+	return os::freertos::details::lock_word_trylock(lock_word(__m));
+}
+
+int std::__libcpp_mutex_unlock(std::__libcpp_mutex_t* __m)
+{
+	os::freertos::details::lock_word_unlock(lock_word(__m));
 	return 0;
 }
 
@@ -71,6 +123,78 @@ int std::__libcpp_thread_destroy(std::__libcpp_thread_t* __t)
 	return 0;
 }
 
+/*
+ * Blocks on the thread's completion notification; see Thread::join(). libc++ drops its handle
+ * after a join, so the Thread object and its task are released here, like pthread_join().
+ */
+int std::__libcpp_thread_join(std::__libcpp_thread_t* __t)
+{
+	if(!*__t)
+	{
+		return EINVAL;
+	}
+
+	(*__t)->join();
+	os::Factory::destroy(*__t);
+	*__t = nullptr;
+
+	return 0;
+}
+
+// The thread releases its Thread object and deletes its task when the thread function returns
+int std::__libcpp_thread_detach(std::__libcpp_thread_t* __t)
+{
+	if(!*__t)
+	{
+		return EINVAL;
+	}
+
+	static_cast<os::freertos::Thread*>(*__t)->detach([](os::freertos::Thread* t) {
+		os::Factory::destroy(static_cast<embvm::VirtualThread*>(t));
+	});
+	*__t = nullptr;
+
+	return 0;
+}
+
+void std::__libcpp_thread_yield()
+{
+	taskYIELD();
+}
+
+void std::__libcpp_thread_sleep_for(const std::chrono::nanoseconds& __ns)
+{
+	if(__ns.count() > 0)
+	{
+		vTaskDelay(os::freertos::durationToDelayTicks(__ns));
+	}
+}
+
+/*
+ * Thread IDs are FreeRTOS task handles, so threads that were not created through std::thread
+ * (including the caller of main()) have an ID as well.
+ */
+
+std::__libcpp_thread_id std::__libcpp_thread_get_current_id()
+{
+	return reinterpret_cast<std::__libcpp_thread_id>(xTaskGetCurrentTaskHandle());
+}
+
+std::__libcpp_thread_id std::__libcpp_thread_get_id(const std::__libcpp_thread_t* __t)
+{
+	return *__t ? reinterpret_cast<std::__libcpp_thread_id>((*__t)->native_handle()) : nullptr;
+}
+
+bool std::__libcpp_thread_id_equal(std::__libcpp_thread_id __t1, std::__libcpp_thread_id __t2)
+{
+	return __t1 == __t2;
+}
+
+bool std::__libcpp_thread_id_less(std::__libcpp_thread_id __t1, std::__libcpp_thread_id __t2)
+{
+	return reinterpret_cast<uintptr_t>(__t1) < reinterpret_cast<uintptr_t>(__t2);
+}
+
 #pragma mark - Condition Variable -
 
 int std::__libcpp_condvar_create(std::__libcpp_condvar_t* __cv)
@@ -79,15 +203,74 @@ int std::__libcpp_condvar_create(std::__libcpp_condvar_t* __cv)
 	return 0;
 }
 
+namespace
+{
+inline os::freertos::ConditionVariable* condvar(std::__libcpp_condvar_t* __cv) noexcept
+{
+	// std::condition_variable is constant-initialized, so it is created on first use. Two tasks
+	// can get here at once, so publish with a compare-and-swap and discard the loser's object.
+	auto cv = __atomic_load_n(__cv, __ATOMIC_ACQUIRE);
+	if(!cv)
+	{
+		std::__libcpp_condvar_t created = os::Factory::createConditionVariable();
+		assert(created);
+
+		if(__atomic_compare_exchange_n(__cv, &cv, created, false, __ATOMIC_ACQ_REL,
+									   __ATOMIC_ACQUIRE))
+		{
+			cv = created;
+		}
+		else
+		{
+			os::Factory::destroy(created);
+		}
+	}
+
+	return reinterpret_cast<os::freertos::ConditionVariable*>(cv);
+}
+} // namespace
+
+int std::__libcpp_condvar_signal(std::__libcpp_condvar_t* __cv)
+{
+	// Nobody can be waiting on a condition variable that has not been created
+	if(*__cv)
+	{
+		(*__cv)->signal();
+	}
+
+	return 0;
+}
+
+int std::__libcpp_condvar_broadcast(std::__libcpp_condvar_t* __cv)
+{
+	if(*__cv)
+	{
+		(*__cv)->broadcast();
+	}
+
+	return 0;
+}
+
+int std::__libcpp_condvar_wait(std::__libcpp_condvar_t* __cv, std::__libcpp_mutex_t* __m)
+{
+	condvar(__cv)->wait(lock_word(__m));
+	return 0;
+}
+
 int std::__libcpp_condvar_timedwait(std::__libcpp_condvar_t* __cv, std::__libcpp_mutex_t* __m,
 									timespec* __ts)
 {
-	if(!*__cv)
+	// libcpp passes an absolute system_clock time, which it computed from system_clock::now()
+	auto deadline = std::chrono::seconds(__ts->tv_sec) + std::chrono::nanoseconds(__ts->tv_nsec);
+	auto remaining = deadline - std::chrono::system_clock::now().time_since_epoch();
+	TickType_t ticks = 0;
+	if(remaining.count() > 0)
 	{
-		__libcpp_condvar_create(__cv);
+		ticks = os::freertos::durationToTicks(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(remaining));
 	}
 
-	bool success = reinterpret_cast<os::freertos::ConditionVariable*>(*__cv)->wait(*__m, *__ts);
+	bool success = condvar(__cv)->wait(lock_word(__m), ticks);
 
 	return success ? 0 : ETIMEDOUT;
 }
@@ -106,41 +289,134 @@ int std::__libcpp_condvar_destroy(std::__libcpp_condvar_t* __cv)
 
 #pragma mark - Thread Local Storage -
 
-/// This function is called once, and the primary purpose is to register the destructor function
-/// which will eventually free libcpp's thread data.
-/// FreeRTOS can ignore the key.
 int std::__libcpp_tls_create(std::__libcpp_tls_key* __key,
 							 void(_LIBCPP_TLS_DESTRUCTOR_CC* __at_exit)(void*))
 {
-	(void)__key;
-	os::freertos::register_threadexit_func(__at_exit);
+	os::freertos::tls_key_t key;
+	if(!os::freertos::tls::createKey(&key, __at_exit))
+	{
+		return EAGAIN;
+	}
+
+	*__key = static_cast<std::__libcpp_tls_key>(key);
 	return 0;
 }
 
-// Only one value is supported: 0, so key is ignored
-// This function updates the calling thread! Call from the thread you want to store data into.
+// Reads the calling thread's value
 void* std::__libcpp_tls_get(std::__libcpp_tls_key __key)
 {
-	(void)__key;
-	return pvTaskGetThreadLocalStoragePointer(nullptr, 0);
+	return os::freertos::tls::get(static_cast<os::freertos::tls_key_t>(__key));
 }
 
-// Only one value is supported: 0, so key is ignored
-// This function updates the calling thread! Call from the thread you want to store data into.
+// Updates the calling thread's value
 int std::__libcpp_tls_set(std::__libcpp_tls_key __key, void* __p)
 {
-	(void)__key;
-	vTaskSetThreadLocalStoragePointer(nullptr, 0, __p);
-	return 0;
+	return os::freertos::tls::set(static_cast<os::freertos::tls_key_t>(__key), __p) ? 0 : ENOMEM;
 }
 
 #pragma mark - Execute Once -
 
-// Execute once
+/*
+ * The once flag holds one of three states:
+ *	- 0: The initializer has not run
+ *	- ONCE_DONE: The initializer has finished
+ *	- Otherwise: The address of the running initializer's OnceRecord
+ *
+ * Once initialization is done, call_once costs a single acquire load. Tasks that race the
+ * initializer add themselves to the OnceRecord's waiter list and block on a task
+ * notification. The record lives on the initializer's stack. It is only accessed inside a
+ * critical section while the flag still points to it, so it cannot go away underneath a waiter.
+ */
+
+static_assert(sizeof(std::__libcpp_exec_once_flag) >= sizeof(uintptr_t),
+			  "The once flag must be able to hold a pointer");
+
+namespace
+{
+constexpr uintptr_t ONCE_DONE = 1;
+
+struct OnceWaiter
+{
+	TaskHandle_t task;
+	volatile bool done;
+	OnceWaiter* next;
+};
+
+struct OnceRecord
+{
+	TaskHandle_t owner;
+	OnceWaiter* waiters;
+};
+
+inline uintptr_t* once_word(std::__libcpp_exec_once_flag* flag) noexcept
+{
+	return reinterpret_cast<uintptr_t*>(flag);
+}
+
+void wait_for_initializer(uintptr_t* word, uintptr_t state) noexcept
+{
+	OnceWaiter self{xTaskGetCurrentTaskHandle(), false, nullptr};
+
+	taskENTER_CRITICAL();
+	// The initializer may have finished since we loaded the flag
+	if(__atomic_load_n(word, __ATOMIC_ACQUIRE) == state)
+	{
+		auto record = reinterpret_cast<OnceRecord*>(state);
+		assert(record->owner != self.task && "Recursive call_once on the same flag");
+		self.next = record->waiters;
+		record->waiters = &self;
+	}
+	else
+	{
+		self.done = true;
+	}
+	taskEXIT_CRITICAL();
+
+	while(!self.done)
+	{
+		ulTaskNotifyTakeIndexed(os::freertos::notify_index::once, pdTRUE, portMAX_DELAY);
+	}
+}
+} // namespace
+
 int std::__libcpp_execute_once(std::__libcpp_exec_once_flag* flag, void (*init_routine)(void))
 {
-	(void)flag;
-	(void)init_routine;
-	// return pthread_once(flag, init_routine);
-	return -1;
+	auto word = once_word(flag);
+
+	auto state = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+	if(state == ONCE_DONE)
+	{
+		return 0;
+	}
+
+	OnceRecord record{xTaskGetCurrentTaskHandle(), nullptr};
+
+	while(state == 0)
+	{
+		if(__atomic_compare_exchange_n(word, &state, reinterpret_cast<uintptr_t>(&record), false,
+									   __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+		{
+			init_routine();
+
+			// Waiter nodes can go out of scope as soon as `done` is set, so they are woken
+			// inside the same critical section that publishes completion
+			taskENTER_CRITICAL();
+			__atomic_store_n(word, ONCE_DONE, __ATOMIC_RELEASE);
+			for(auto w = record.waiters; w; w = w->next)
+			{
+				w->done = true;
+				xTaskNotifyGiveIndexed(w->task, os::freertos::notify_index::once);
+			}
+			taskEXIT_CRITICAL();
+
+			return 0;
+		}
+	}
+
+	if(state != ONCE_DONE)
+	{
+		wait_for_initializer(word, state);
+	}
+
+	return 0;
 }
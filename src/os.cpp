@@ -4,15 +4,16 @@
 #include "os.hpp"
 #include "freertos_os_helpers.hpp"
 #include <FreeRTOS.h>
-#include <etl/pool.h>
 #include <task.h>
 
-// TODO: Size 0 should enable new/delete and ETL types should not be declared.
-
 using namespace os::freertos;
 
 #pragma mark - Definitions -
 
+// Each factory pool holds this many objects statically. When they are all in use, objects come
+// from the heap if OS_POOL_HEAP_OVERFLOW is set. A size of 0 allocates every object from the
+// heap and requires OS_POOL_HEAP_OVERFLOW. See HybridPool.
+
 #ifndef OS_CV_POOL_SIZE
 #define OS_CV_POOL_SIZE 4
 #endif
@@ -33,17 +34,81 @@ using namespace os::freertos;
 #define OS_EVENT_FLAG_POOL_SIZE 4
 #endif
 
+#ifndef OS_FAST_MUTEX_POOL_SIZE
+#define OS_FAST_MUTEX_POOL_SIZE 4
+#endif
+
+#if configSUPPORT_STATIC_ALLOCATION
+#ifndef OS_STATIC_MUTEX_POOL_SIZE
+#define OS_STATIC_MUTEX_POOL_SIZE 4
+#endif
+
+#ifndef OS_STATIC_RECURSIVE_MUTEX_POOL_SIZE
+#define OS_STATIC_RECURSIVE_MUTEX_POOL_SIZE 4
+#endif
+
+#ifndef OS_STATIC_SEMAPHORE_POOL_SIZE
+#define OS_STATIC_SEMAPHORE_POOL_SIZE 4
+#endif
+
+#ifndef OS_STATIC_EVENT_FLAG_POOL_SIZE
+#define OS_STATIC_EVENT_FLAG_POOL_SIZE 4
+#endif
+#endif
+
 #pragma mark - Static Memory Pools -
 
 namespace
 {
-etl::pool<ConditionVariable, OS_CV_POOL_SIZE> cv_factory_;
-etl::pool<Thread, OS_THREAD_POOL_SIZE> thread_factory_;
-etl::pool<Mutex, OS_MUTEX_POOL_SIZE> mutex_factory_;
-etl::pool<Semaphore, OS_SEMAPHORE_POOL_SIZE> semaphore_factory_;
-etl::pool<EventFlag, OS_EVENT_FLAG_POOL_SIZE> event_factory_;
+HybridPool<ConditionVariable, OS_CV_POOL_SIZE> cv_factory_;
+HybridPool<Thread, OS_THREAD_POOL_SIZE> thread_factory_;
+HybridPool<Mutex, OS_MUTEX_POOL_SIZE> mutex_factory_;
+HybridPool<Semaphore, OS_SEMAPHORE_POOL_SIZE> semaphore_factory_;
+HybridPool<EventFlag, OS_EVENT_FLAG_POOL_SIZE> event_factory_;
+HybridPool<FastMutex, OS_FAST_MUTEX_POOL_SIZE> fast_mutex_factory_;
+
+#if configSUPPORT_STATIC_ALLOCATION
+HybridPool<StaticMutex<>, OS_STATIC_MUTEX_POOL_SIZE> static_mutex_factory_;
+HybridPool<StaticRecursiveMutex, OS_STATIC_RECURSIVE_MUTEX_POOL_SIZE>
+	static_recursive_mutex_factory_;
+HybridPool<StaticSemaphore, OS_STATIC_SEMAPHORE_POOL_SIZE> static_semaphore_factory_;
+HybridPool<StaticEventFlag, OS_STATIC_EVENT_FLAG_POOL_SIZE> static_event_factory_;
+#endif
 } // namespace
 
+#pragma mark - Pool Statistics -
+
+PoolStats os::freertos::factoryPoolStats(FactoryPool pool) noexcept
+{
+	switch(pool)
+	{
+		case FactoryPool::condition_variable:
+			return cv_factory_.stats();
+		case FactoryPool::thread:
+			return thread_factory_.stats();
+		case FactoryPool::mutex:
+			return mutex_factory_.stats();
+		case FactoryPool::semaphore:
+			return semaphore_factory_.stats();
+		case FactoryPool::event_flag:
+			return event_factory_.stats();
+		case FactoryPool::fast_mutex:
+			return fast_mutex_factory_.stats();
+#if configSUPPORT_STATIC_ALLOCATION
+		case FactoryPool::static_mutex:
+			return static_mutex_factory_.stats();
+		case FactoryPool::static_recursive_mutex:
+			return static_recursive_mutex_factory_.stats();
+		case FactoryPool::static_semaphore:
+			return static_semaphore_factory_.stats();
+		case FactoryPool::static_event_flag:
+			return static_event_factory_.stats();
+#endif
+	}
+
+	return {};
+}
+
 #pragma mark - FreeRTOS Handlers -
 
 extern "C" void vApplicationStackOverflowHook(TaskHandle_t xTask, char* pcTaskName)
@@ -103,7 +168,16 @@ void freertosOSFactory_impl::destroy_impl(embvm::VirtualThread* item) noexcept
 void freertosOSFactory_impl::destroy_impl(embvm::VirtualMutex* item) noexcept
 {
 	assert(item);
-	mutex_factory_.destroy(reinterpret_cast<Mutex*>(item));
+
+	// A FastMutex passed as a VirtualMutex must go back to its own pool
+	if(FastMutex::is(item))
+	{
+		fast_mutex_factory_.destroy(static_cast<FastMutex*>(item));
+	}
+	else
+	{
+		mutex_factory_.destroy(static_cast<Mutex*>(item));
+	}
 }
 
 void freertosOSFactory_impl::destroy_impl(embvm::VirtualSemaphore* item) noexcept
@@ -118,9 +192,70 @@ void freertosOSFactory_impl::destroy_impl(embvm::VirtualEventFlag* item) noexcep
 	event_factory_.destroy(reinterpret_cast<EventFlag*>(item));
 }
 
+FastMutex* freertosOSFactory_impl::createFastMutex_impl(embvm::mutex::type type) noexcept
+{
+	return fast_mutex_factory_.create(type);
+}
+
+void freertosOSFactory_impl::destroy_impl(FastMutex* item) noexcept
+{
+	assert(item);
+	fast_mutex_factory_.destroy(item);
+}
+
+#pragma mark - Static Primitive Factory Functions -
+
+#if configSUPPORT_STATIC_ALLOCATION
+StaticMutex<>* freertosOSFactory_impl::createStaticMutex_impl() noexcept
+{
+	return static_mutex_factory_.create();
+}
+
+StaticRecursiveMutex* freertosOSFactory_impl::createStaticRecursiveMutex_impl() noexcept
+{
+	return static_recursive_mutex_factory_.create();
+}
+
+StaticSemaphore* freertosOSFactory_impl::createStaticSemaphore_impl(
+	embvm::semaphore::mode mode, embvm::semaphore::count_t ceiling,
+	embvm::semaphore::count_t initial_count) noexcept
+{
+	return static_semaphore_factory_.create(mode, ceiling, initial_count);
+}
+
+StaticEventFlag* freertosOSFactory_impl::createStaticEventFlag_impl() noexcept
+{
+	return static_event_factory_.create();
+}
+
+void freertosOSFactory_impl::destroy_impl(StaticMutex<>* item) noexcept
+{
+	assert(item);
+	static_mutex_factory_.destroy(item);
+}
+
+void freertosOSFactory_impl::destroy_impl(StaticRecursiveMutex* item) noexcept
+{
+	assert(item);
+	static_recursive_mutex_factory_.destroy(item);
+}
+
+void freertosOSFactory_impl::destroy_impl(StaticSemaphore* item) noexcept
+{
+	assert(item);
+	static_semaphore_factory_.destroy(item);
+}
+
+void freertosOSFactory_impl::destroy_impl(StaticEventFlag* item) noexcept
+{
+	assert(item);
+	static_event_factory_.destroy(item);
+}
+#endif
+
 #pragma mark - Supporting Functions -
 
-void os::freertos::startScheduler()
+void os::freertos::startScheduler() noexcept
 {
 	vTaskStartScheduler();
 }
@@ -6,12 +6,39 @@
 
 #include "freertos_condition_variable.hpp"
 #include "freertos_event_flags.hpp"
+#include "freertos_executor.hpp"
+#include "freertos_fast_mutex.hpp"
+#include "freertos_lock_profiler.hpp"
 #include "freertos_msg_queue.hpp"
 #include "freertos_mutex.hpp"
+#include "freertos_object_pool.hpp"
+#include "freertos_periodic_thread.hpp"
 #include "freertos_semaphore.hpp"
+#include "freertos_spsc_ring.hpp"
+#include "freertos_static_primitives.hpp"
 #include "freertos_thread.hpp"
+#include "freertos_tls.hpp"
+#include "freertos_zero_copy_queue.hpp"
 #include <rtos/rtos.hpp>
 
+/// Number of queues in each fixed-capacity message queue pool. See OS_POOL_HEAP_OVERFLOW.
+#ifndef OS_MSG_QUEUE_POOL_SIZE
+#define OS_MSG_QUEUE_POOL_SIZE 4
+#endif
+
+/**
+ * Capacity of the queues handed out by createMessageQueue_impl() when
+ * configSUPPORT_DYNAMIC_ALLOCATION is disabled. Requested queue lengths must not exceed it.
+ */
+#ifndef OS_MSG_QUEUE_STATIC_CAPACITY
+#define OS_MSG_QUEUE_STATIC_CAPACITY 16
+#endif
+
+/// Number of rings in each SpscRing pool. See OS_POOL_HEAP_OVERFLOW.
+#ifndef OS_SPSC_RING_POOL_SIZE
+#define OS_SPSC_RING_POOL_SIZE 2
+#endif
+
 namespace os
 {
 namespace freertos
@@ -23,6 +50,37 @@ namespace freertos
 /// init() function.
 void startScheduler() noexcept;
 
+/// The object pools behind freertosOSFactory_impl
+enum class FactoryPool
+{
+	condition_variable,
+	thread,
+	mutex,
+	semaphore,
+	event_flag,
+	fast_mutex,
+#if configSUPPORT_STATIC_ALLOCATION
+	static_mutex,
+	static_recursive_mutex,
+	static_semaphore,
+	static_event_flag,
+#endif
+};
+
+/// Usage counters for one of the factory's object pools.
+PoolStats factoryPoolStats(FactoryPool pool) noexcept;
+
+namespace details
+{
+/// One pool per message type and capacity, constructed during static initialization.
+template<typename TType, size_t TCapacity>
+inline HybridPool<MessageQueue<TType, TCapacity>, OS_MSG_QUEUE_POOL_SIZE>
+	message_queue_factory_;
+
+template<typename TType, size_t TCapacity>
+inline HybridPool<SpscRing<TType, TCapacity>, OS_SPSC_RING_POOL_SIZE> spsc_ring_factory_;
+} // namespace details
+
 /// Implementation of the FreeRTOS OS Factory
 /// For API documentation, see embvm::embvm::VirtualOSFactory
 /// @related embvm::embvm::VirtualOSFactory
@@ -44,20 +102,130 @@ class freertosOSFactory_impl
 		createSemaphore_impl(embvm::semaphore::mode mode, embvm::semaphore::count_t ceiling,
 							 embvm::semaphore::count_t initial_count) noexcept;
 
+	/** Create a message queue.
+	 *
+	 * The queue is allocated from the FreeRTOS heap. When configSUPPORT_DYNAMIC_ALLOCATION is
+	 * disabled, the queue is taken from a pool of MessageQueue<TType,
+	 * OS_MSG_QUEUE_STATIC_CAPACITY> objects instead, and a queue_length larger than
+	 * OS_MSG_QUEUE_STATIC_CAPACITY returns nullptr.
+	 */
 	template<typename TType>
 	static embvm::VirtualMessageQueue<TType>* createMessageQueue_impl(size_t queue_length) noexcept
 	{
+#if configSUPPORT_DYNAMIC_ALLOCATION
 		return new freertos::MessageQueue<TType>(queue_length);
+#else
+		return createStaticMessageQueue_impl<TType, OS_MSG_QUEUE_STATIC_CAPACITY>(queue_length);
+#endif
+	}
+
+	template<typename TType>
+	static void destroy_impl(embvm::VirtualMessageQueue<TType>* item) noexcept
+	{
+#if configSUPPORT_DYNAMIC_ALLOCATION
+		delete item;
+#else
+		destroy_impl(static_cast<MessageQueue<TType, OS_MSG_QUEUE_STATIC_CAPACITY>*>(item));
+#endif
+	}
+
+	/** Create a message queue with inline storage from a static pool.
+	 *
+	 * Each TType/TCapacity combination has its own pool of OS_MSG_QUEUE_POOL_SIZE queues.
+	 * Returns nullptr if the pool and the heap are exhausted, or if queue_length is 0 or
+	 * larger than TCapacity. Release the queue with destroy_impl().
+	 *
+	 * @param queue_length The queue length, which must not exceed TCapacity.
+	 */
+	template<typename TType, size_t TCapacity>
+	static MessageQueue<TType, TCapacity>*
+		createStaticMessageQueue_impl(size_t queue_length = TCapacity) noexcept
+	{
+		static_assert(TCapacity > 0, "Pooled message queues require a non-zero capacity");
+
+		if(queue_length == 0 || queue_length > TCapacity)
+		{
+			return nullptr;
+		}
+
+		return details::message_queue_factory_<TType, TCapacity>.create(queue_length);
+	}
+
+	template<typename TType, size_t TCapacity>
+	static void destroy_impl(MessageQueue<TType, TCapacity>* item) noexcept
+	{
+		assert(item);
+
+		if constexpr(TCapacity == 0)
+		{
+			delete item;
+		}
+		else
+		{
+			details::message_queue_factory_<TType, TCapacity>.destroy(item);
+		}
 	}
 
 	static embvm::VirtualEventFlag* createEventFlag_impl() noexcept;
 
+	/** Create a lock-free single-producer, single-consumer ring. See os::freertos::SpscRing.
+	 *
+	 * Each TType/TCapacity combination has its own pool of OS_SPSC_RING_POOL_SIZE rings.
+	 * Returns nullptr if the pool and the heap are exhausted.
+	 */
+	template<typename TType, size_t TCapacity>
+	static SpscRing<TType, TCapacity>* createSpscRing_impl() noexcept
+	{
+		return details::spsc_ring_factory_<TType, TCapacity>.create();
+	}
+
+	template<typename TType, size_t TCapacity>
+	static void destroy_impl(SpscRing<TType, TCapacity>* item) noexcept
+	{
+		assert(item);
+		details::spsc_ring_factory_<TType, TCapacity>.destroy(item);
+	}
+
 	static void destroy_impl(embvm::VirtualConditionVariable* item) noexcept;
 	static void destroy_impl(embvm::VirtualThread* item) noexcept;
 	static void destroy_impl(embvm::VirtualMutex* item) noexcept;
 	static void destroy_impl(embvm::VirtualSemaphore* item) noexcept;
 	static void destroy_impl(embvm::VirtualEventFlag* item) noexcept;
 
+	/** Create a mutex with an atomic fast path.
+	 *
+	 * Uncontended lock/unlock operations do not enter the kernel. See os::freertos::FastMutex.
+	 * Release the mutex with destroy_impl(). The VirtualMutex overload also recognizes a
+	 * FastMutex and returns it to the right pool.
+	 */
+	static FastMutex*
+		createFastMutex_impl(embvm::mutex::type type = embvm::mutex::type::defaultType) noexcept;
+	static void destroy_impl(FastMutex* item) noexcept;
+
+#if configSUPPORT_STATIC_ALLOCATION
+	/** @name Statically dispatched primitives
+	 *
+	 * These functions hand out the non-virtual primitives declared in
+	 * freertos_static_primitives.hpp. Use them when the caller does not need runtime
+	 * polymorphism. They are not part of the embvm::VirtualOSFactory interface, so call them
+	 * through freertosOSFactory_impl directly.
+	 */
+	///@{
+	static StaticMutex<>* createStaticMutex_impl() noexcept;
+	static StaticRecursiveMutex* createStaticRecursiveMutex_impl() noexcept;
+	static StaticSemaphore*
+		createStaticSemaphore_impl(embvm::semaphore::mode mode = embvm::semaphore::mode::counting,
+								   embvm::semaphore::count_t ceiling = 1,
+								   embvm::semaphore::count_t initial_count = -1) noexcept;
+	static StaticEventFlag* createStaticEventFlag_impl() noexcept;
+
+	static void destroy_impl(StaticMutex<>* item) noexcept;
+	static void destroy_impl(StaticRecursiveMutex* item) noexcept;
+	static void destroy_impl(StaticSemaphore* item) noexcept;
+	static void destroy_impl(StaticEventFlag* item) noexcept;
+	///@}
+#endif
+
   public:
 	freertosOSFactory_impl() = default;
 	~freertosOSFactory_impl() = default;